@@ -1,15 +1,118 @@
-#include "yobot_paint.h"
+#include "yobot_paintPool.h"
 #include "yobot_bossData.h"
+#include "yobot_renderCache.h"
+#include "yobot_iconCache.h"
+#include "yobot_clanStore.h"
+#include "yobot_metrics.h"
+#include "yobot_progress.h"
+#include "yobot_prefork.h"
+#include "yobot_pixels.h"
 #include <httplib.h>
 #include <spdlog/spdlog.h>
-#include <shared_mutex>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <mutex>
+#include <format>
 #include <fstream>
+#include <span>
+#include <stdexcept>
+#include <utility>
 
 constexpr auto Version = std::string_view("Branch: " GIT_BRANCH "\nCommit: " GIT_VERSION "\nDate: " GIT_DATE);
 constexpr auto LogPattern = "%m-%d %H:%M:%S.%e [%^%l%$] [thread:%t] [%s:%#] %v";
 constexpr auto DefaultArea = yobot::area::cn;
 constexpr auto DefaultHost = "0.0.0.0";
 constexpr auto DefaultPort = 9540;
+// Above 1, a supervisor forks this many server processes sharing the port.
+const auto DefaultProcesses = GetEnvOr<std::size_t>("YOBOT_PROCESSES", 1);
+// Render threads per process. By default the cores are split between the processes, since
+// each worker holds a paint context per scale and the HTTP pool is sized from this too.
+const auto DefaultWorkers = GetEnvOr<std::size_t>("YOBOT_WORKERS", std::max<std::size_t>(1, std::thread::hardware_concurrency() / std::max<std::size_t>(DefaultProcesses, 1)));
+const auto DefaultQueueDepth = GetEnvOr<std::size_t>("YOBOT_QUEUE_DEPTH", 64);
+const auto DefaultCacheBytes = GetEnvOr<std::size_t>("YOBOT_CACHE_BYTES", 64 * 1024 * 1024);
+const auto DefaultIconCacheBytes = GetEnvOr<std::size_t>("YOBOT_ICON_CACHE_BYTES", 16 * 1024 * 1024);
+const auto DefaultBatchLimit = GetEnvOr<std::size_t>("YOBOT_BATCH_LIMIT", 512);
+// Each /clan/events subscriber holds an HTTP thread for as long as it stays connected.
+const auto DefaultMaxSubscribers = GetEnvOr<std::size_t>("YOBOT_MAX_SUBSCRIBERS", 32);
+const auto DefaultMaxClans = GetEnvOr<std::size_t>("YOBOT_MAX_CLANS", 10000);
+const auto DefaultClanIdle = std::chrono::seconds(GetEnvOr<std::int64_t>("YOBOT_CLAN_IDLE", 86400));
+const auto DefaultPNGLevel = GetEnvOr<int>("YOBOT_PNG_LEVEL", 1);
+// Forces a pixel kernel implementation (avx2, sse4.1, neon, scalar) instead of the detected one.
+const auto PixelKernels = GetEnvOr("YOBOT_PIXELS", "");
+// standard (480x640), compact or wide; see yobot_layout.h.
+const auto DefaultLayout = yobot::layout::parse(GetEnvOr("YOBOT_LAYOUT", "standard")).value_or(yobot::LayoutKind::STANDARD);
+// classic or dark; the colors of whichever layout is in use.
+const auto DefaultTheme = yobot::theme::parse(GetEnvOr("YOBOT_THEME", "classic")).value_or(yobot::Theme::CLASSIC);
+const auto BossDataHost = GetEnvOr("YOBOT_BOSS_DATA_HOST", "https://pcr.satroki.tech");
+const auto IconHost = GetEnvOr("YOBOT_ICON_HOST", "https://redive.estertion.win");
+const auto DefaultRefreshInterval = std::chrono::seconds(GetEnvOr<std::int64_t>("YOBOT_REFRESH_INTERVAL", 3600));
+const auto DefaultSharedCacheBytes = GetEnvOr<std::size_t>("YOBOT_SHARED_CACHE_BYTES", 256 * 1024 * 1024);
+constexpr auto SharedCacheSlotBytes = 4096;
+constexpr auto FollowInterval = std::chrono::seconds(1);
+constexpr auto UpdateTimeout = std::chrono::seconds(60);
+constexpr auto BossDataPath = "bossData.json";
+constexpr auto SubscriptionKeepAlive = std::chrono::seconds(15);
+const auto StartTime = std::chrono::steady_clock::now();
+// Generations restart at 1 with every server, so ETags also carry its start. Forked
+// workers inherit the supervisor's value, so they all agree on every ETag.
+const auto InstanceTag = (std::uint64_t)std::chrono::system_clock::now().time_since_epoch().count();
+// Size of a body handed to httplib through a content provider, for the access log.
+// The handler sets it and the logger takes it, both on the connection's thread.
+static thread_local std::size_t ProvidedBytes = 0;
+
+// Clan ids end up in URLs pushed to subscribers, so they are kept to URL-safe characters.
+static bool ValidClanId(std::string_view clan)
+{
+    return !clan.empty() && clan.size() <= 64 && std::ranges::all_of(clan, [](char c) {
+        return std::isalnum((unsigned char)c) || c == '-' || c == '_';
+    });
+}
+
+// Status bodies may be JSON, CBOR or MessagePack; nullopt for any other content type.
+static std::optional<json::input_format_t> BodyFormat(const httplib::Request& req)
+{
+    auto type = std::string_view(req.get_header_value("Content-Type"));
+    type = type.substr(0, type.find(';'));
+    if (type.empty() || type == "application/json")
+    {
+        return json::input_format_t::json;
+    }
+    if (type == "application/cbor")
+    {
+        return json::input_format_t::cbor;
+    }
+    if (type == "application/msgpack" || type == "application/x-msgpack" || type == "application/vnd.msgpack")
+    {
+        return json::input_format_t::msgpack;
+    }
+    return std::nullopt;
+}
+
+static std::optional<yobot::ImageFormat> RequestFormat(const httplib::Request& req)
+{
+    return req.has_param("format") ? yobot::imageFormat::parse(req.get_param_value("format")) : std::optional(yobot::imageFormat::negotiate(req.get_header_value("Accept")));
+}
+
+// 0.5, 1 or 2 times the layout's canvas, each drawn natively rather than resampled.
+static std::optional<yobot::Scale> RequestScale(const httplib::Request& req)
+{
+    return req.has_param("scale") ? yobot::scale::parse(req.get_param_value("scale")) : std::optional(yobot::Scale::ONE);
+}
+
+static std::optional<yobot::ClanDelta> ParseDelta(const std::string& body)
+{
+    try
+    {
+        return json::parse(body).get<yobot::ClanDelta>();
+    }
+    catch (const json::exception& e)
+    {
+        SPDLOG_WARN("{}", e.what());
+        return std::nullopt;
+    }
+}
 
 static bool DownloadBinaryFile(const std::string_view& host, const std::string_view& getPath, const std::string_view& savePath)
 {
@@ -28,11 +131,15 @@ static bool DownloadBinaryFile(const std::string_view& host, const std::string_v
 static void InitEnv()
 {
     spdlog::default_logger()->set_pattern(LogPattern);
+    if (!PixelKernels.empty() && !yobot::pixels::select(PixelKernels))
+    {
+        SPDLOG_WARN("pixel kernels {} unavailable, using {}", PixelKernels, yobot::pixels::isa());
+    }
     std::filesystem::create_directory(IconDir);
     if (!std::filesystem::exists(DefaultIconPath.data))
     {
         constexpr auto getPath = FixedString("/icon/unit/") + FixedString(DefaultIcon);
-        DownloadBinaryFile("https://redive.estertion.win", getPath.data, DefaultIconPath.data);
+        DownloadBinaryFile(IconHost, getPath.data, DefaultIconPath.data);
     }
     std::filesystem::create_directory(FontDir);
     if (!std::filesystem::exists(DefaultFontPath.data))
@@ -42,94 +149,673 @@ static void InitEnv()
     }
 }
 
-static void Update(json& bossData)
+using BossSnapshotPtr = std::shared_ptr<const yobot::BossSnapshot>;
+
+static void WarmIcons(const yobot::BossSnapshot& snapshot)
 {
-    yobot::updateBossData(bossData);
-    SPDLOG_INFO(bossData["boss_id"][DefaultArea].dump());
-    std::promise<yobot::unique_sdl_surface> drawPromise;
-    std::function<void()> drawProcess = [&] {
-        yobot::paint::getInstance().preparePanel(bossData["boss_id"][DefaultArea]);
-    };
-    yobot::paint::getInstance().postDrawProcess(drawProcess, drawPromise);
-    drawPromise.get_future().wait();
-}
-
-static auto PrepareRenderData(const json& statusData, const json& bossData)
-{
-    auto lap = statusData.at("lap").get<json::number_integer_t>();
-    auto phase = yobot::getPhase(bossData, lap, DefaultArea);
-    auto&& lapRange = bossData["lap_range"][DefaultArea][phase];
-    auto lapMin = lapRange[0].get<json::number_integer_t>();
-    auto lapMax = lapRange[1].get<json::number_integer_t>();
-    const std::array<bool, 5> &lapFlags = statusData.at("lap_flags");
-    auto&& bossHPs = statusData.at("boss_hps");
-    auto&& bossFullHPs = bossData["boss_hp"][DefaultArea][phase];
-    std::array<yobot::Progress, 5> bossProgreses;
-    for (size_t i = 0; i < bossProgreses.size(); i++)
-    {
-        bossProgreses[i] = { bossHPs.at(i),bossFullHPs[i] };
-    }
-    auto currentTime = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    auto startTime = bossData["time_range"][DefaultArea][0].get<json::number_integer_t>();
-    auto endTime = bossData["time_range"][DefaultArea][1].get<json::number_integer_t>();
-    std::array<yobot::Progress, 2> totalProgesses = { {
-        {(endTime > currentTime ? endTime - currentTime : 0),endTime - startTime},
-        {(lapMax == 999 ? 0 : lapMax - lap + 1),lapMax - lapMin + 1}
-    } };
-    phase += 'A';
-    return std::make_tuple(lap, lapFlags, phase, totalProgesses, bossProgreses);
-}
-
-static void Progress(const json& statusData, const json& bossData, std::string& body)
-{
-    auto&& [lap, lapFlags, phase, totalProgesses, bossProgreses] = PrepareRenderData(statusData, bossData);
-    std::promise<yobot::unique_sdl_surface> drawPromise;
-    std::function<void()> drawProcess = [&] {
-        yobot::paint::getInstance()
-            .refreshBackground(phase)
-            .refreshTotalProgress(phase, totalProgesses)
-            .refreshBossProgress(lap, lapFlags, bossProgreses);
-    };
-    yobot::paint::getInstance().postDrawProcess(drawProcess, drawPromise);
-    yobot::paint::savePNGBuffer(drawPromise.get_future().get(), body);
+    std::vector<std::uint64_t> ids;
+    for (auto&& areaData : snapshot.areas)
+    {
+        if (areaData.valid())
+        {
+            ids.insert(ids.end(), areaData.bossId.begin(), areaData.bossId.end());
+        }
+    }
+    // Every scale has a context of its own, so each icon size is decoded ahead of the first render.
+    for (auto&& scale : yobot::scale::all)
+    {
+        yobot::iconCache::getInstance().warm(ids, yobot::layout::get(DefaultLayout, scale, DefaultTheme).icon);
+    }
 }
 
-int main(int argc, char const *argv[])
+// Panels belong to one generation, so every area's is rebuilt on all workers in parallel
+// before requests see the new snapshot.
+static void PreparePanels(yobot::paintPool& pool, const BossSnapshotPtr& snapshot)
 {
-    InitEnv();
+    pool.broadcast([&snapshot](yobot::paint& context) {
+        for (auto&& area : yobot::area::all)
+        {
+            yobot::ensurePanel(context, *snapshot, area);
+        }
+    });
+}
+
+static void Refresh(json& bossData, std::atomic<BossSnapshotPtr>& bossSnapshot, yobot::renderCache& cache, yobot::paintPool& pool, std::span<const std::string_view> areas, yobot::sharedGeneration* generations)
+{
+    auto start = std::chrono::steady_clock::now();
+    // Only the requested areas are fetched, so bossData, the file saved from it and the
+    // snapshot compiled from it always hold the same boss data.
+    auto changes = yobot::updateBossData(bossData, { BossDataHost, IconHost }, areas);
+    auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    SPDLOG_INFO("refresh changed:{} validators:{} cost:{}ms", changes.data, changes.validators, cost.count());
+    if (!changes.data)
+    {
+        // Same data under new validators: saved as is, still under the current generation,
+        // so a restart sends them instead of downloading everything again.
+        if (changes.validators && !yobot::saveBossData(bossData, BossDataPath))
+        {
+            SPDLOG_WARN("failed to save {}", BossDataPath);
+        }
+        return;
+    }
+    auto next = yobot::compileBossData(bossData, bossSnapshot.load()->generation + 1);
+    for (auto&& area : areas)
+    {
+        if (auto areaData = next->find(area))
+        {
+            SPDLOG_INFO("{} {}", area, json(areaData->bossId).dump());
+        }
+    }
+    // The file names its generation, so a follower can tell it from data saved for a later one.
+    bossData["generation"] = next->generation;
+    auto saved = yobot::saveBossData(bossData, BossDataPath);
+    if (!saved)
+    {
+        SPDLOG_WARN("failed to save {}", BossDataPath);
+    }
+    // Followers only ever see the saved file, so in prefork mode a generation that could not
+    // be saved is dropped, keeping one generation number to one set of boss data everywhere.
+    if (generations && !saved)
+    {
+        yobot::loadBossData(bossData, BossDataPath);
+        return;
+    }
+    WarmIcons(*next);
+    PreparePanels(pool, next);
+    auto generation = next->generation;
+    bossSnapshot.store(std::move(next));
+    cache.clear();
+    if (generations)
+    {
+        generations->publish(generation);
+    }
+}
+
+// Picks up boss data another worker process saved and published. That file is exactly
+// what the fetching worker compiled its snapshot from, so every process renders a given
+// generation the same way and render keys and ETags stay valid across processes.
+static void Follow(json& bossData, std::atomic<BossSnapshotPtr>& bossSnapshot, yobot::renderCache& cache, yobot::paintPool& pool, const yobot::sharedGeneration& generations)
+{
+    auto generation = generations.current();
+    if (generation == bossSnapshot.load()->generation)
+    {
+        return;
+    }
+    json loaded;
+    // The fetching worker saves before it publishes, so the file may already hold a later
+    // generation than the one published; retry on the next tick until they agree.
+    if (!yobot::loadBossData(loaded, BossDataPath) || loaded.value("generation", std::uint64_t(0)) != generation)
+    {
+        return;
+    }
+    bossData = std::move(loaded);
+    auto next = yobot::compileBossData(bossData, generation);
+    SPDLOG_INFO("followed generation:{}", generation);
+    WarmIcons(*next);
+    PreparePanels(pool, next);
+    bossSnapshot.store(std::move(next));
+    cache.clear();
+}
+
+static std::string MakeETag(const yobot::RenderKey& key)
+{
+    return std::format("\"{:016x}{:016x}\"", InstanceTag, yobot::RenderKeyHash{}(key));
+}
+
+// The process's own cache first, then the one shared with the other worker processes.
+static yobot::renderCache::Buffer FindCached(yobot::renderCache& cache, yobot::sharedCache* shared, const yobot::RenderKey& key)
+{
+    if (auto buffer = cache.find(key))
+    {
+        return buffer;
+    }
+    auto buffer = shared ? shared->find(key) : nullptr;
+    if (buffer)
+    {
+        cache.insert(key, buffer);
+    }
+    return buffer;
+}
+
+static void InsertCached(yobot::renderCache& cache, yobot::sharedCache* shared, const yobot::RenderKey& key, const yobot::renderCache::Buffer& buffer)
+{
+    cache.insert(key, buffer);
+    if (shared)
+    {
+        shared->insert(key, buffer);
+    }
+}
+
+// Returns nullptr when the render queue is full.
+static yobot::renderCache::Buffer Progress(yobot::paintPool& pool, yobot::renderCache& cache, yobot::sharedCache* shared, yobot::renderFlights& flights, const yobot::RenderKey& key, const yobot::RenderData& renderData, const BossSnapshotPtr& snapshot)
+{
+    if (auto buffer = FindCached(cache, shared, key))
+    {
+        return buffer;
+    }
+    return flights.run(key, [&]() -> yobot::renderCache::Buffer {
+        auto body = std::make_shared<std::string>();
+        auto drawFuture = pool.postDrawProcess([&](yobot::paint& context) {
+            yobot::drawProgress(context, *snapshot, key, renderData, *body);
+        }, key.scale);
+        if (!drawFuture.valid())
+        {
+            return nullptr;
+        }
+        drawFuture.get();
+        InsertCached(cache, shared, key, body);
+        return body;
+    });
+}
+
+struct BatchEntry
+{
+    yobot::RenderKey key;
+    yobot::RenderData renderData;
+    yobot::renderCache::Buffer buffer;
+};
+
+// Renders every cache miss back-to-back in a single job, so consecutive items share the
+// worker's panel and dirty-band state. Every entry has the same scale. Returns false when
+// the render queue is full.
+static bool ProgressBatch(yobot::paintPool& pool, yobot::renderCache& cache, yobot::sharedCache* shared, std::vector<BatchEntry*>& entries, const BossSnapshotPtr& snapshot)
+{
+    std::vector<BatchEntry*> misses;
+    for (auto&& entry : entries)
+    {
+        entry->buffer = FindCached(cache, shared, entry->key);
+        if (!entry->buffer)
+        {
+            misses.emplace_back(entry);
+        }
+    }
+    if (misses.empty())
+    {
+        return true;
+    }
+    std::vector<std::shared_ptr<std::string>> bodies(misses.size());
+    auto drawFuture = pool.postDrawProcess([&](yobot::paint& context) {
+        for (std::size_t i = 0; i < misses.size(); i++)
+        {
+            bodies[i] = std::make_shared<std::string>();
+            yobot::drawProgress(context, *snapshot, misses[i]->key, misses[i]->renderData, *bodies[i]);
+        }
+    }, misses[0]->key.scale);
+    if (!drawFuture.valid())
+    {
+        return false;
+    }
+    drawFuture.get();
+    for (std::size_t i = 0; i < misses.size(); i++)
+    {
+        misses[i]->buffer = bodies[i];
+        InsertCached(cache, shared, misses[i]->key, bodies[i]);
+    }
+    return true;
+}
+
+// One server process. In prefork mode shared and generations are mapped by the
+// supervisor and worker 0 is the only one fetching boss data.
+static int Serve(std::size_t index, yobot::sharedCache* shared, yobot::sharedGeneration* generations)
+{
+    auto fetcher = !generations || index == 0;
     json bossData;
-    yobot::updateBossData(bossData);
-    std::shared_mutex mtBossData;
-    SPDLOG_INFO(bossData["boss_id"][DefaultArea].dump());
-    yobot::paint::getInstance()
-        .loadRes()
-        .preparePanel(bossData["boss_id"][DefaultArea])
-        .show();
+    auto loaded = yobot::loadBossData(bossData, BossDataPath);
+    SPDLOG_INFO("{} loaded:{}", BossDataPath, loaded);
+    std::mutex mtUpdate;
+    // Worker 0 may already have saved the next generation without publishing it yet; data
+    // is always compiled under the generation its file names, never under a newer or older one.
+    auto generation = !generations ? 1 : loaded ? bossData.value("generation", generations->current()) : generations->current();
+    std::atomic<BossSnapshotPtr> bossSnapshot(yobot::compileBossData(bossData, generation));
+    yobot::renderCache cache(DefaultCacheBytes);
+    yobot::renderFlights flights;
+    yobot::paintPool pool(DefaultWorkers, DefaultQueueDepth, DefaultLayout, DefaultTheme);
+    yobot::iconCache::getInstance().setCapacity(DefaultIconCacheBytes);
+    yobot::encoder::getInstance().setPNGLevel(DefaultPNGLevel);
+    yobot::encoder::getInstance().setPaletteSeeds(yobot::paint::themeColors(DefaultTheme));
+    auto reportFollowed = [&] {
+        if (generations)
+        {
+            generations->followed(index, bossSnapshot.load()->generation);
+        }
+    };
+    WarmIcons(*bossSnapshot.load());
+    PreparePanels(pool, bossSnapshot.load());
+    std::jthread refresher([&](std::stop_token stoken) {
+        std::mutex mtWait;
+        std::condition_variable_any cvWait;
+        auto due = std::chrono::steady_clock::now();
+        while (!stoken.stop_requested())
+        {
+            {
+                std::lock_guard lock(mtUpdate);
+                if (fetcher)
+                {
+                    auto [ticket, requested] = generations ? generations->take() : std::pair<std::uint64_t, std::vector<std::string_view>>();
+                    if (std::chrono::steady_clock::now() >= due)
+                    {
+                        Refresh(bossData, bossSnapshot, cache, pool, yobot::area::all, generations);
+                        due = std::chrono::steady_clock::now() + DefaultRefreshInterval;
+                    }
+                    else if (!requested.empty())
+                    {
+                        Refresh(bossData, bossSnapshot, cache, pool, requested, generations);
+                    }
+                    if (generations)
+                    {
+                        generations->served(ticket);
+                    }
+                }
+                else
+                {
+                    Follow(bossData, bossSnapshot, cache, pool, *generations);
+                }
+                reportFollowed();
+            }
+            // Worker processes poll the shared generation; a lone server just sleeps until the next refresh.
+            std::unique_lock lock(mtWait);
+            cvWait.wait_for(lock, stoken, generations ? FollowInterval : DefaultRefreshInterval, [] { return false; });
+        }
+    });
+    yobot::clanStore clans(DefaultMaxClans, DefaultClanIdle);
+    std::atomic<std::size_t> subscribers = 0;
+    auto serveProgress = [&](const httplib::Request& req, httplib::Response& resp, const yobot::ClanStatus& status, std::string_view area) {
+        yobot::stageTimer timer(yobot::Stage::TOTAL);
+        auto format = RequestFormat(req);
+        auto scale = RequestScale(req);
+        if (!format || !scale)
+        {
+            resp.status = httplib::BadRequest_400;
+            return;
+        }
+        auto snapshot = bossSnapshot.load();
+        if (!snapshot->find(area))
+        {
+            resp.status = httplib::NotFound_404;
+            return;
+        }
+        auto renderData = yobot::prepareRenderData(status, *snapshot->find(area));
+        auto key = yobot::makeRenderKey(snapshot->generation, area, renderData, *format, DefaultLayout, *scale);
+        auto etag = MakeETag(key);
+        resp.set_header("ETag", etag);
+        resp.set_header("Cache-Control", std::format("max-age={}", yobot::renderTTL(renderData, DefaultLayout, *scale)));
+        resp.set_header("Vary", "Accept");
+        auto ifNoneMatch = req.get_header_value("If-None-Match");
+        if (ifNoneMatch == "*" || ifNoneMatch.find(etag) != std::string::npos)
+        {
+            resp.status = httplib::NotModified_304;
+            return;
+        }
+        auto buffer = Progress(pool, cache, shared, flights, key, renderData, snapshot);
+        if (!buffer)
+        {
+            resp.status = httplib::ServiceUnavailable_503;
+            resp.set_header("Retry-After", "1");
+            return;
+        }
+        // Serve straight from the shared encoded buffer instead of copying it into the body.
+        ProvidedBytes = buffer->size();
+        resp.set_content_provider(buffer->size(), std::string(yobot::imageFormat::contentType(*format)),
+            [buffer](size_t offset, size_t length, httplib::DataSink& sink) {
+                return sink.write(buffer->data() + offset, std::min(length, buffer->size() - offset));
+            });
+    };
     httplib::Server server;
+    if (generations)
+    {
+        yobot::reusePort(server);
+        // Clan state lives in each process while connections land on any of them, so a clan
+        // stored by one worker would be missing on the next. Refused until it is shared.
+        SPDLOG_WARN("clan endpoints are disabled with YOBOT_PROCESSES > 1");
+        server.set_pre_routing_handler([](const httplib::Request& req, httplib::Response& resp) {
+            if (req.path == "/clan" || req.path.starts_with("/clan/"))
+            {
+                resp.status = httplib::NotImplemented_501;
+                resp.set_content("clan endpoints need YOBOT_PROCESSES=1", "text/plain");
+                return httplib::Server::HandlerResponse::Handled;
+            }
+            return httplib::Server::HandlerResponse::Unhandled;
+        });
+    }
+    // Enough threads for every subscriber on top of the renders that can be queued or
+    // running, so open event streams never hold up /progress.
+    server.new_task_queue = [] {
+        return new httplib::ThreadPool(DefaultMaxSubscribers + DefaultQueueDepth + std::max<std::size_t>(DefaultWorkers, 1));
+    };
     std::jthread httpServer([&]() {
         server.set_logger([](const httplib::Request& req, const httplib::Response& resp) {
-            SPDLOG_INFO("[{}] {} {} status: {} bytes: {}", req.method, req.path, json(req.params).dump(), resp.status, resp.body.size());
+            static std::once_flag firstResponse;
+            std::call_once(firstResponse, [] {
+                SPDLOG_INFO("first response {}ms after start", std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - StartTime).count());
+            });
+            auto provided = std::exchange(ProvidedBytes, 0);
+            SPDLOG_INFO("[{}] {} {} status: {} bytes: {}", req.method, req.path, json(req.params).dump(), resp.status, resp.body.empty() ? provided : resp.body.size());
         }).Get("/", [](const httplib::Request& req, httplib::Response& resp) {
             resp.body = Version;
         }).Get("/update", [&](const httplib::Request& req, httplib::Response& resp) {
-            std::unique_lock lock(mtBossData);
-            Update(bossData);
+            auto areas = std::span<const std::string_view>(yobot::area::all);
+            auto area = yobot::area::parse(req.get_param_value("area"));
+            if (req.has_param("area"))
+            {
+                if (!area)
+                {
+                    resp.status = httplib::BadRequest_400;
+                    return;
+                }
+                areas = std::span<const std::string_view>(&*area, 1);
+            }
+            if (!fetcher)
+            {
+                // Worker 0 fetches; every other worker follows the generation it publishes.
+                if (!generations->wait(generations->request(areas), UpdateTimeout))
+                {
+                    resp.status = httplib::GatewayTimeout_504;
+                    return;
+                }
+                std::lock_guard lock(mtUpdate);
+                Follow(bossData, bossSnapshot, cache, pool, *generations);
+                reportFollowed();
+            }
+            else
+            {
+                std::lock_guard lock(mtUpdate);
+                Refresh(bossData, bossSnapshot, cache, pool, areas, generations);
+                reportFollowed();
+            }
+            // Answers once every worker process serves the new data, not just this one.
+            if (generations && !generations->waitFollowed(bossSnapshot.load()->generation, UpdateTimeout))
+            {
+                resp.status = httplib::GatewayTimeout_504;
+            }
         }).Get("/progress", [&](const httplib::Request& req, httplib::Response& resp) {
-            auto it = req.params.find("data");
-            if (it == req.params.end())
+            yobot::ClanStatus status;
+            auto area = req.has_param("area") ? yobot::area::parse(req.get_param_value("area")) : std::optional(DefaultArea);
+            if (!area || !yobot::parseClanStatus(req.get_param_value("data"), json::input_format_t::json, status))
+            {
+                resp.status = httplib::BadRequest_400;
+                return;
+            }
+            serveProgress(req, resp, status, *area);
+        }).Post("/progress", [&](const httplib::Request& req, httplib::Response& resp) {
+            yobot::ClanStatus status;
+            auto area = req.has_param("area") ? yobot::area::parse(req.get_param_value("area")) : std::optional(DefaultArea);
+            auto bodyFormat = BodyFormat(req);
+            if (!bodyFormat)
+            {
+                resp.status = httplib::UnsupportedMediaType_415;
+                return;
+            }
+            if (!area || !yobot::parseClanStatus(req.body, *bodyFormat, status))
+            {
+                resp.status = httplib::BadRequest_400;
+                return;
+            }
+            serveProgress(req, resp, status, *area);
+        }).Post("/progress/batch", [&](const httplib::Request& req, httplib::Response& resp) {
+            std::vector<yobot::ClanStatusItem> items;
+            auto area = req.has_param("area") ? yobot::area::parse(req.get_param_value("area")) : std::optional(DefaultArea);
+            auto format = RequestFormat(req);
+            auto scale = RequestScale(req);
+            auto bodyFormat = BodyFormat(req);
+            if (!bodyFormat)
+            {
+                resp.status = httplib::UnsupportedMediaType_415;
+                return;
+            }
+            if (!area || !format || !scale)
+            {
+                resp.status = httplib::BadRequest_400;
+                return;
+            }
+            if (auto parsed = yobot::parseClanStatusBatch(req.body, *bodyFormat, DefaultBatchLimit, items); parsed != yobot::BatchParse::OK)
             {
-                resp.status = 500;
+                resp.status = parsed == yobot::BatchParse::TOO_LARGE ? httplib::PayloadTooLarge_413 : httplib::BadRequest_400;
                 return;
             }
-            auto data = json::parse(it->second);
-            std::shared_lock lock(mtBossData);
-            Progress(data, bossData, resp.body);
-            resp.set_header("Content-Type", "image/png");
-        }).Get("/quit", [](const httplib::Request& req, httplib::Response& resp) {
-            yobot::paint::getInstance().postQuit();
+            auto snapshot = bossSnapshot.load();
+            std::vector<BatchEntry> entries(items.size());
+            std::vector<BatchEntry*> renders;
+            for (std::size_t i = 0; i < items.size(); i++)
+            {
+                auto itemArea = items[i].area.value_or(*area);
+                if (auto areaData = snapshot->find(itemArea))
+                {
+                    entries[i].renderData = yobot::prepareRenderData(items[i].status, *areaData);
+                    entries[i].key = yobot::makeRenderKey(snapshot->generation, itemArea, entries[i].renderData, *format, DefaultLayout, *scale);
+                    renders.emplace_back(&entries[i]);
+                }
+            }
+            if (!ProgressBatch(pool, cache, shared, renders, snapshot))
+            {
+                resp.status = httplib::ServiceUnavailable_503;
+                resp.set_header("Retry-After", "1");
+                return;
+            }
+            // multipart/mixed in request order; items of an area without boss data are empty 404 parts.
+            auto boundary = std::format("yobot-batch-{:016x}", InstanceTag);
+            auto parts = std::make_shared<std::vector<std::pair<std::string, yobot::renderCache::Buffer>>>();
+            for (auto&& entry : entries)
+            {
+                auto header = entry.buffer
+                    ? std::format("\r\n--{}\r\nContent-Type: {}\r\nContent-Length: {}\r\nETag: {}\r\nX-Status: 200\r\n\r\n",
+                        boundary, yobot::imageFormat::contentType(*format), entry.buffer->size(), MakeETag(entry.key))
+                    : std::format("\r\n--{}\r\nContent-Length: 0\r\nX-Status: 404\r\n\r\n", boundary);
+                parts->emplace_back(std::move(header), entry.buffer);
+            }
+            parts->emplace_back(std::format("\r\n--{}--\r\n", boundary), nullptr);
+            ProvidedBytes = 0;
+            for (auto&& [header, buffer] : *parts)
+            {
+                ProvidedBytes += header.size() + (buffer ? buffer->size() : 0);
+            }
+            resp.set_header("Vary", "Accept");
+            resp.set_chunked_content_provider(std::format("multipart/mixed; boundary={}", boundary), [parts](size_t offset, httplib::DataSink& sink) {
+                for (auto&& [header, buffer] : *parts)
+                {
+                    if (!sink.write(header.data(), header.size()) || (buffer && !sink.write(buffer->data(), buffer->size())))
+                    {
+                        return false;
+                    }
+                }
+                sink.done();
+                return true;
+            });
+        }).Post("/clan", [&](const httplib::Request& req, httplib::Response& resp) {
+            yobot::ClanStatus status;
+            auto clan = req.get_param_value("clan");
+            auto area = req.has_param("area") ? yobot::area::parse(req.get_param_value("area")) : std::optional(DefaultArea);
+            auto bodyFormat = BodyFormat(req);
+            if (!bodyFormat)
+            {
+                resp.status = httplib::UnsupportedMediaType_415;
+                return;
+            }
+            if (!ValidClanId(clan) || !area || !yobot::parseClanStatus(req.body, *bodyFormat, status))
+            {
+                resp.status = httplib::BadRequest_400;
+                return;
+            }
+            auto version = clans.put(clan, *area, status);
+            resp.set_content(json{ {"version", version} }.dump(), "application/json");
+        }).Post("/clan/delta", [&](const httplib::Request& req, httplib::Response& resp) {
+            auto clan = req.get_param_value("clan");
+            if (!clans.find(clan))
+            {
+                resp.status = httplib::NotFound_404;
+                return;
+            }
+            auto delta = ParseDelta(req.body);
+            auto version = delta ? clans.apply(clan, *delta) : std::nullopt;
+            if (!version)
+            {
+                resp.status = httplib::BadRequest_400;
+                return;
+            }
+            resp.set_content(json{ {"version", *version} }.dump(), "application/json");
+        }).Get("/clan/progress", [&](const httplib::Request& req, httplib::Response& resp) {
+            auto state = clans.find(req.get_param_value("clan"));
+            if (!state)
+            {
+                resp.status = httplib::NotFound_404;
+                return;
+            }
+            serveProgress(req, resp, state->status, state->area);
+        }).Get("/clan/events", [&](const httplib::Request& req, httplib::Response& resp) {
+            auto clan = req.get_param_value("clan");
+            if (!clans.find(clan))
+            {
+                resp.status = httplib::NotFound_404;
+                return;
+            }
+            // The event URL asks for the image the way this subscriber would.
+            std::string imageParams;
+            if (req.has_param("format"))
+            {
+                auto format = yobot::imageFormat::parse(req.get_param_value("format"));
+                if (!format)
+                {
+                    resp.status = httplib::BadRequest_400;
+                    return;
+                }
+                imageParams += std::format("&format={}", yobot::imageFormat::name(*format));
+            }
+            if (req.has_param("scale"))
+            {
+                auto scale = yobot::scale::parse(req.get_param_value("scale"));
+                if (!scale)
+                {
+                    resp.status = httplib::BadRequest_400;
+                    return;
+                }
+                imageParams += std::format("&scale={}", yobot::scale::name(*scale));
+            }
+            if (++subscribers > DefaultMaxSubscribers)
+            {
+                subscribers--;
+                resp.status = httplib::ServiceUnavailable_503;
+                resp.set_header("Retry-After", std::to_string(SubscriptionKeepAlive.count()));
+                return;
+            }
+            // Gives the subscriber slot back once httplib drops the provider.
+            auto slot = std::shared_ptr<void>(nullptr, [&subscribers](void*) { subscribers--; });
+            resp.set_header("Cache-Control", "no-cache");
+            // Holds one server thread per subscriber; the keepalive lets dropped clients be noticed.
+            resp.set_chunked_content_provider("text/event-stream", [&clans, clan, imageParams, slot, seen = std::uint64_t(0)](size_t offset, httplib::DataSink& sink) mutable {
+                auto state = clans.wait(clan, seen, SubscriptionKeepAlive);
+                if (!state)
+                {
+                    sink.done();
+                    return true;
+                }
+                if (state->version == seen)
+                {
+                    constexpr auto keepAlive = std::string_view(": keepalive\n\n");
+                    return sink.write(keepAlive.data(), keepAlive.size());
+                }
+                seen = state->version;
+                json event = {
+                    {"version", seen},
+                    {"url", std::format("/clan/progress?clan={}&v={}{}", clan, seen, imageParams)},
+                    {"status", state->status}
+                };
+                auto message = std::format("event: progress\ndata: {}\n\n", event.dump());
+                return sink.write(message.data(), message.size());
+            });
+        }).Get("/stats", [&](const httplib::Request& req, httplib::Response& resp) {
+            json stats;
+            stats["generation"] = bossSnapshot.load()->generation;
+            stats["process"] = index;
+            stats["cache"] = {
+                {"hits", cache.hits()},
+                {"misses", cache.misses()},
+                {"bytes", cache.bytes()},
+                {"entries", cache.size()}
+            };
+            stats["queue"] = {
+                {"depth", pool.pending()},
+                {"capacity", pool.capacity()},
+                {"workers", pool.size()},
+                {"shed", pool.shed()}
+            };
+            stats["flights"] = {
+                {"inflight", flights.inflight()},
+                {"coalesced", flights.coalesced()}
+            };
+            if (shared)
+            {
+                stats["sharedCache"] = {
+                    {"hits", shared->hits()},
+                    {"misses", shared->misses()}
+                };
+            }
+            stats["clans"] = clans.size();
+            stats["subscribers"] = subscribers.load();
+            for (auto&& format : yobot::imageFormat::all)
+            {
+                auto encoded = yobot::encoder::getInstance().stats(format);
+                stats["encoder"][yobot::imageFormat::name(format)] = {
+                    {"count", encoded.count},
+                    {"bytes", encoded.bytes},
+                    {"micros", encoded.micros},
+                    {"avgBytes", encoded.count ? encoded.bytes / encoded.count : 0},
+                    {"avgMicros", encoded.count ? encoded.micros / encoded.count : 0}
+                };
+            }
+            resp.set_content(stats.dump(), "application/json");
+        }).Get("/metrics", [&](const httplib::Request& req, httplib::Response& resp) {
+            std::string out;
+            yobot::metrics::getInstance().write(out);
+            yobot::metrics::writeValue(out, "yobot_generation", "gauge", (double)bossSnapshot.load()->generation);
+            yobot::metrics::writeValue(out, "yobot_queue_depth", "gauge", (double)pool.pending());
+            yobot::metrics::writeValue(out, "yobot_queue_capacity", "gauge", (double)pool.capacity());
+            yobot::metrics::writeValue(out, "yobot_workers", "gauge", (double)pool.size());
+            yobot::metrics::writeValue(out, "yobot_shed_total", "counter", (double)pool.shed());
+            yobot::metrics::writeValue(out, "yobot_cache_hits_total", "counter", (double)cache.hits());
+            yobot::metrics::writeValue(out, "yobot_cache_misses_total", "counter", (double)cache.misses());
+            yobot::metrics::writeValue(out, "yobot_cache_bytes", "gauge", (double)cache.bytes());
+            yobot::metrics::writeValue(out, "yobot_cache_entries", "gauge", (double)cache.size());
+            yobot::metrics::writeValue(out, "yobot_flights_inflight", "gauge", (double)flights.inflight());
+            yobot::metrics::writeValue(out, "yobot_flights_coalesced_total", "counter", (double)flights.coalesced());
+            yobot::metrics::writeValue(out, "yobot_icon_cache_bytes", "gauge", (double)yobot::iconCache::getInstance().bytes());
+            yobot::metrics::writeValue(out, "yobot_clans", "gauge", (double)clans.size());
+            if (shared)
+            {
+                yobot::metrics::writeValue(out, "yobot_shared_cache_hits_total", "counter", (double)shared->hits());
+                yobot::metrics::writeValue(out, "yobot_shared_cache_misses_total", "counter", (double)shared->misses());
+            }
+            resp.set_content(out, "text/plain; version=0.0.4");
+        }).Get("/quit", [&](const httplib::Request& req, httplib::Response& resp) {
+            if (generations)
+            {
+                yobot::stopPrefork();
+                return;
+            }
+            pool.postQuit();
         }).listen(DefaultHost, DefaultPort);
     });
-    yobot::paint::getInstance().mainLoop();
+    pool.mainLoop();
+    clans.close();
     server.stop();
     return 0;
 }
+
+int main(int argc, char const *argv[])
+{
+    InitEnv();
+    if (DefaultProcesses > 1)
+    {
+        // Mapped before forking so every worker shares them.
+        yobot::sharedCache shared(DefaultSharedCacheBytes, DefaultSharedCacheBytes / SharedCacheSlotBytes);
+        yobot::sharedGeneration generations(DefaultProcesses);
+        // The file on disk starts this run's first generation, whatever it was last run.
+        if (json bossData; yobot::loadBossData(bossData, BossDataPath))
+        {
+            bossData["generation"] = generations.current();
+            yobot::saveBossData(bossData, BossDataPath);
+        }
+        return yobot::prefork(DefaultProcesses, [&](std::size_t index) {
+            return Serve(index, shared.valid() ? &shared : nullptr, &generations);
+        });
+    }
+    return Serve(0, nullptr, nullptr);
+}
@@ -1,5 +1,11 @@
 #pragma once
 #include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <format>
+#include <string>
+#include <string_view>
+#include <system_error>
 
 template <typename T, auto Destructor>
 struct GenericDeleter
@@ -32,4 +38,44 @@ struct FixedString
         std::copy_n(other.data, M, result.data + N - 1);
         return result;
     }
-};
\ No newline at end of file
+};
+
+// Text formatted in place with a fixed capacity; output past N bytes is cut off.
+template<size_t N>
+struct TextBuffer
+{
+    char data[N]{};
+    size_t size = 0;
+
+    template<typename... Args>
+    TextBuffer& format(std::format_string<Args...> fmt, Args&&... args)
+    {
+        auto ret = std::format_to_n(data, N, fmt, std::forward<Args>(args)...);
+        size = std::min<size_t>(ret.size, N);
+        return *this;
+    }
+
+    std::string_view view() const { return { data, size }; }
+
+    bool operator==(const TextBuffer& other) const { return view() == other.view(); }
+};
+
+template<typename T>
+T GetEnvOr(const char* name, T defaultValue)
+{
+    auto env = std::getenv(name);
+    if (!env)
+    {
+        return defaultValue;
+    }
+    auto str = std::string_view(env);
+    T value{};
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+    return ec == std::errc() && ptr == str.data() + str.size() ? value : defaultValue;
+}
+
+inline std::string GetEnvOr(const char* name, const char* defaultValue)
+{
+    auto env = std::getenv(name);
+    return env ? env : defaultValue;
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "yobot_arena.h"
+#include <bit>
+#include <new>
+
+namespace yobot {
+
+    void arena::reset()
+    {
+        if (m_demand > m_capacity)
+        {
+            m_capacity = std::bit_ceil(m_demand);
+            m_block = std::make_unique_for_overwrite<std::byte[]>(m_capacity);
+        }
+        m_used = 0;
+        m_demand = 0;
+    }
+
+    std::size_t arena::capacity() const
+    {
+        return m_capacity;
+    }
+
+    std::size_t arena::spills() const
+    {
+        return m_spills;
+    }
+
+    void* arena::do_allocate(std::size_t bytes, std::size_t alignment)
+    {
+        auto base = (std::size_t)m_block.get();
+        auto offset = (base + m_used + alignment - 1) / alignment * alignment - base;
+        m_demand += offset - m_used + bytes;
+        if (m_block && offset + bytes <= m_capacity)
+        {
+            m_used = offset + bytes;
+            return m_block.get() + offset;
+        }
+        m_demand += alignment;
+        m_spills++;
+        return ::operator new(bytes, std::align_val_t(alignment));
+    }
+
+    void arena::do_deallocate(void* ptr, std::size_t, std::size_t alignment)
+    {
+        if (!owns(ptr))
+        {
+            ::operator delete(ptr, std::align_val_t(alignment));
+        }
+    }
+
+    bool arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+    {
+        return this == &other;
+    }
+
+    bool arena::owns(const void* ptr) const
+    {
+        auto p = static_cast<const std::byte*>(ptr);
+        return m_block && p >= m_block.get() && p < m_block.get() + m_capacity;
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+namespace yobot {
+
+    // Bump allocator for the scratch memory of one request. Freeing into it is a no-op
+    // and reset() drops everything at once; when the last round did not fit, reset() grows
+    // the block to what that round used, so a warm arena stops touching the heap.
+    class arena : public std::pmr::memory_resource
+    {
+    public:
+        arena() = default;
+        arena(arena&) = delete;
+        arena(arena&&) = delete;
+    public:
+        // Only call while nothing allocated from the arena is still in use.
+        void reset();
+        std::size_t capacity() const;
+        // Requests that missed the block since the arena was created.
+        std::size_t spills() const;
+    protected:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    private:
+        bool owns(const void* ptr) const;
+    private:
+        std::unique_ptr<std::byte[]> m_block;
+        std::size_t m_capacity = 0;
+        std::size_t m_used = 0;
+        // Bytes this round asked for, including what spilled to the heap.
+        std::size_t m_demand = 0;
+        std::size_t m_spills = 0;
+    };
+}
@@ -0,0 +1,692 @@
+#include "yobot_paintPool.h"
+#include "yobot_progress.h"
+#include "yobot_iconCache.h"
+#include "yobot_pixels.h"
+#include <SDL3/SDL_stdinc.h>
+#include <httplib.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// yobot_bench micro [fixtureDir]
+//     Micro-benchmarks of the render path against an in-process fixture server.
+// yobot_bench fixture [fixtureDir] [port]
+//     Serves the fixture only, for a yobot_paintpp started with YOBOT_BOSS_DATA_HOST
+//     and YOBOT_ICON_HOST pointing at it.
+// yobot_bench load <url> [threads] [seconds] [distinct]
+//     Drives /progress of a running server and reports throughput, p50 and p99.
+// yobot_bench record <fixtureDir>
+//     Captures the live upstream responses as a fixture.
+//
+// Without a recorded fixture the server synthesizes clan battles ending five days from
+// now and answers every icon with the default icon, so nothing touches the network.
+// Synthetic unit ids are 9xxxxx, outside the real range, so a server pointed at the
+// fixture never stores the default icon under a real boss's file name. micro runs in a
+// scratch directory and needs font/ from the directory it was started in.
+
+constexpr auto LiveBossDataHost = "https://pcr.satroki.tech";
+constexpr auto LiveIconHost = "https://redive.estertion.win";
+constexpr auto FixtureHost = "127.0.0.1";
+
+using Clock = std::chrono::steady_clock;
+
+// Calls into operator new on this thread, for the steady-state allocation check.
+static thread_local std::uint64_t Allocations = 0;
+
+static void* CountedAlloc(std::size_t size, std::size_t alignment)
+{
+    Allocations++;
+    size = std::max<std::size_t>(size, 1);
+#ifdef _WIN32
+    auto ptr = _aligned_malloc(size, alignment);
+#else
+    auto ptr = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+static void CountedFree(void* ptr) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void* operator new(std::size_t size)
+{
+    return CountedAlloc(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    return CountedAlloc(size, std::max<std::size_t>((std::size_t)alignment, __STDCPP_DEFAULT_NEW_ALIGNMENT__));
+}
+
+void operator delete(void* ptr) noexcept
+{
+    CountedFree(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    CountedFree(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    CountedFree(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept
+{
+    CountedFree(ptr);
+}
+
+// Calls into SDL_malloc on this thread. SDL keeps its own allocator, so it is hooked separately.
+static thread_local std::uint64_t SDLAllocations = 0;
+
+static void* SDLCALL CountedSDLMalloc(std::size_t size)
+{
+    SDLAllocations++;
+    return std::malloc(size);
+}
+
+static void* SDLCALL CountedSDLCalloc(std::size_t count, std::size_t size)
+{
+    SDLAllocations++;
+    return std::calloc(count, size);
+}
+
+static void* SDLCALL CountedSDLRealloc(void* ptr, std::size_t size)
+{
+    SDLAllocations++;
+    return std::realloc(ptr, size);
+}
+
+static void SDLCALL CountedSDLFree(void* ptr)
+{
+    std::free(ptr);
+}
+
+static std::string ReadFile(const std::filesystem::path& path)
+{
+    auto ifs = std::ifstream(path, std::ios::binary);
+    return ifs ? std::string(std::istreambuf_iterator<char>(ifs), {}) : std::string();
+}
+
+static std::string SyntheticClanBattles(std::size_t areaIndex)
+{
+    constexpr std::array<std::pair<int, int>, 5> laps = { { {1, 3}, {4, 10}, {11, 30}, {31, 40}, {41, 999} } };
+    auto now = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+    auto battle = [&](auto start, auto end) {
+        json phases = json::array();
+        for (std::size_t phase = 0; phase < laps.size(); phase++)
+        {
+            json bosses = json::array();
+            for (std::size_t i = 0; i < 5; i++)
+            {
+                bosses.push_back({
+                    {"unitId", 900000 + areaIndex * 100 + i * 10},
+                    {"name", std::format("boss{}", i + 1)},
+                    {"hp", (6 + i) * 1000000 * (phase + 1)}
+                });
+            }
+            phases.push_back({ {"lapFrom", laps[phase].first}, {"lapTo", laps[phase].second}, {"bosses", bosses} });
+        }
+        return json{
+            {"startTime", std::format("{:%FT%T}+00:00", start)},
+            {"endTime", std::format("{:%FT%T}+00:00", end)},
+            {"phases", phases}
+        };
+    };
+    // An older battle first, like the real endpoint; only the last one is used.
+    return json::array({
+        battle(now - std::chrono::days(31), now - std::chrono::days(25)),
+        battle(now - std::chrono::days(1), now + std::chrono::days(5))
+    }).dump();
+}
+
+// Stand-in for the boss data and icon hosts.
+class fixtureServer
+{
+public:
+    explicit fixtureServer(const std::filesystem::path& dir)
+        : m_dir(dir)
+        , m_defaultIcon(ReadFile(DefaultIconPath.data))
+        , m_requests(0)
+    {
+        for (std::size_t i = 0; i < yobot::area::all.size(); i++)
+        {
+            auto recorded = ReadFile(dir / std::format("{}.json", yobot::area::all[i]));
+            m_battles[i] = recorded.empty() ? SyntheticClanBattles(i) : std::move(recorded);
+            m_etags[i] = std::format("\"{:016x}\"", std::hash<std::string>{}(m_battles[i]));
+        }
+        m_server.Get("/api/Quest/GetClanBattleInfos", [this](const httplib::Request& req, httplib::Response& resp) {
+            m_requests++;
+            auto area = yobot::area::parse(req.get_param_value("s"));
+            if (!area)
+            {
+                resp.status = httplib::NotFound_404;
+                return;
+            }
+            auto i = std::ranges::find(yobot::area::all, *area) - yobot::area::all.begin();
+            resp.set_header("ETag", m_etags[i]);
+            if (req.get_header_value("If-None-Match") == m_etags[i])
+            {
+                resp.status = httplib::NotModified_304;
+                return;
+            }
+            resp.set_content(m_battles[i], "application/json");
+        }).Get(R"(/icon/unit/(([0-9]+)\.webp))", [this](const httplib::Request& req, httplib::Response& resp) {
+            m_requests++;
+            auto recorded = ReadFile(m_dir / "icon" / req.matches[1].str());
+            // Only synthetic ids get the stand-in; a real id without a recorded icon stays missing.
+            auto synthetic = req.matches[2].str().size() == 6 && req.matches[2].str().front() == '9';
+            auto&& icon = !recorded.empty() || !synthetic ? recorded : m_defaultIcon;
+            if (icon.empty())
+            {
+                resp.status = httplib::NotFound_404;
+                return;
+            }
+            resp.set_content(icon, "image/webp");
+        });
+    }
+
+    ~fixtureServer()
+    {
+        m_server.stop();
+    }
+
+    // Returns the base URL; port 0 picks a free one.
+    std::string start(int port)
+    {
+        if (port == 0)
+        {
+            port = m_server.bind_to_any_port(FixtureHost);
+        }
+        else
+        {
+            m_server.bind_to_port(FixtureHost, port);
+        }
+        m_thread = std::jthread([this] {
+            m_server.listen_after_bind();
+        });
+        m_server.wait_until_ready();
+        return std::format("http://{}:{}", FixtureHost, port);
+    }
+
+    void wait()
+    {
+        m_thread.join();
+    }
+
+    std::uint64_t requests() const
+    {
+        return m_requests;
+    }
+
+private:
+    std::filesystem::path m_dir;
+    std::string m_defaultIcon;
+    std::array<std::string, yobot::area::all.size()> m_battles;
+    std::array<std::string, yobot::area::all.size()> m_etags;
+    std::atomic<std::uint64_t> m_requests;
+    httplib::Server m_server;
+    std::jthread m_thread;
+};
+
+static void Report(std::string_view name, std::vector<double>& nanos, std::string_view extra = {})
+{
+    std::ranges::sort(nanos);
+    auto mean = std::accumulate(nanos.begin(), nanos.end(), 0.0) / nanos.size();
+    auto at = [&nanos](double q) { return nanos[std::min(nanos.size() - 1, (std::size_t)(q * nanos.size()))]; };
+    std::cout << std::format("{:<28} n={:<7} mean={:>10.0f}ns p50={:>10.0f}ns p99={:>10.0f}ns {}\n", name, nanos.size(), mean, at(0.5), at(0.99), extra);
+}
+
+// Times each call; fast operations are repeated batch times per sample.
+template<typename Func>
+static void Measure(std::string_view name, std::size_t iterations, std::size_t batch, Func&& func, std::string_view extra = {})
+{
+    for (std::size_t i = 0; i < std::max<std::size_t>(iterations / 10, 1); i++)
+    {
+        func(i);
+    }
+    std::vector<double> nanos;
+    nanos.reserve(iterations);
+    for (std::size_t i = 0; i < iterations; i++)
+    {
+        auto start = Clock::now();
+        for (std::size_t j = 0; j < batch; j++)
+        {
+            func(i * batch + j);
+        }
+        nanos.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / batch);
+    }
+    Report(name, nanos, extra);
+}
+
+static yobot::ClanStatus SampleStatus(std::size_t i)
+{
+    yobot::ClanStatus status{ (std::int64_t)(1 + i % 45), {}, {} };
+    for (std::size_t boss = 0; boss < 5; boss++)
+    {
+        status.lapFlags[boss] = (i + boss) % 3 == 0;
+        status.bossHPs[boss] = 1000000 + (i * 7919 + boss * 104729) % 5000000;
+    }
+    return status;
+}
+
+// What /progress did before the typed decoder: a DOM plus .at() conversions.
+static yobot::ClanStatus ParseStatusDOM(const std::string& data)
+{
+    auto statusData = json::parse(data);
+    yobot::ClanStatus status;
+    status.lap = statusData.at("lap").get<json::number_integer_t>();
+    status.lapFlags = statusData.at("lap_flags");
+    status.bossHPs = statusData.at("boss_hps");
+    return status;
+}
+
+static std::uint32_t* PixelRow(SDL_Surface* surface, int y)
+{
+    return reinterpret_cast<std::uint32_t*>(static_cast<std::uint8_t*>(surface->pixels) + (std::ptrdiff_t)y * surface->pitch);
+}
+
+// Renders on a warm context and counts what still reaches operator new and SDL_malloc.
+// libwebp allocates internally with plain malloc, so WebP is reported but not checked.
+static bool SteadyAllocations(yobot::paint& context, const yobot::BossSnapshot& snapshot, const yobot::AreaSnapshot& areaData)
+{
+    constexpr std::size_t Rounds = 64;
+    auto clean = true;
+    for (auto&& format : yobot::imageFormat::all)
+    {
+        std::string body;
+        auto draw = [&](std::size_t i, std::string& out) {
+            auto renderData = yobot::prepareRenderData(SampleStatus(i % 16), areaData);
+            auto key = yobot::makeRenderKey(1, yobot::area::cn, renderData, format, yobot::LayoutKind::STANDARD, yobot::Scale::ONE);
+            yobot::drawProgress(context, snapshot, key, renderData, out);
+        };
+        // The first round takes the scratch arena and the body to their high-water marks.
+        for (std::size_t i = 0; i < Rounds; i++)
+        {
+            draw(i, body);
+        }
+        auto before = Allocations;
+        auto sdlBefore = SDLAllocations;
+        for (std::size_t i = 0; i < Rounds; i++)
+        {
+            draw(i, body);
+        }
+        auto count = Allocations - before;
+        auto sdlCount = SDLAllocations - sdlBefore;
+        // A cache miss in /progress and /progress/batch hands the cache a new body, like this.
+        before = Allocations;
+        for (std::size_t i = 0; i < Rounds; i++)
+        {
+            auto fresh = std::make_shared<std::string>();
+            draw(i, *fresh);
+        }
+        auto served = Allocations - before;
+        auto expected = format != yobot::ImageFormat::WEBP;
+        clean = clean && (count + sdlCount == 0 || !expected);
+        std::cout << std::format("{:<28} {} allocations ({} SDL) in {} draws{}, known {:.1f} per draw for the body of a served miss\n",
+            std::format("steady state {}", yobot::imageFormat::name(format)), count + sdlCount, sdlCount, Rounds,
+            expected ? "" : " (not checked)", (double)served / Rounds);
+    }
+    return clean;
+}
+
+// Every pixel kernel this CPU runs, timed and checked bit for bit against SDL's own fill and blit.
+static bool Pixels()
+{
+    auto&& canvas = yobot::layout::get(yobot::LayoutKind::STANDARD).canvas;
+    auto src = yobot::unique_sdl_surface(SDL_CreateSurface(canvas.x, canvas.y, SDL_PIXELFORMAT_ARGB8888));
+    auto base = yobot::unique_sdl_surface(SDL_CreateSurface(canvas.x, canvas.y, SDL_PIXELFORMAT_ARGB8888));
+    std::mt19937 rng(1);
+    for (int y = 0; y < canvas.y; y++)
+    {
+        for (int x = 0; x < canvas.x; x++)
+        {
+            // Every third source pixel is fully opaque or fully clear, the cases SDL short-cuts.
+            auto pixel = (std::uint32_t)rng();
+            PixelRow(src.get(), y)[x] = x % 3 ? pixel : (pixel & 0xffffff) | (y % 2 ? 0xff000000 : 0);
+            PixelRow(base.get(), y)[x] = (std::uint32_t)rng();
+        }
+    }
+    auto srcRect = SDL_Rect{ 3, 5, canvas.x - 7, canvas.y - 9 };
+    auto pos = SDL_Point{ 1, 2 };
+    auto fillRect = SDL_Rect{ 7, 11, 101, 37 };
+    auto color = SDL_Color{ 0, 153, 255, 128 };
+    auto expected = yobot::unique_sdl_surface(SDL_DuplicateSurface(base.get()));
+    auto dstRect = SDL_Rect{ pos.x, pos.y, srcRect.w, srcRect.h };
+    SDL_SetSurfaceBlendMode(src.get(), SDL_BLENDMODE_BLEND);
+    SDL_BlitSurface(src.get(), &srcRect, expected.get(), &dstRect);
+    SDL_FillSurfaceRect(expected.get(), &fillRect, SDL_MapSurfaceRGBA(expected.get(), color.r, color.g, color.b, color.a));
+
+    auto selected = std::string(yobot::pixels::isa());
+    auto exact = true;
+    for (auto&& name : { "avx2", "sse4.1", "neon", "scalar" })
+    {
+        if (!yobot::pixels::select(name))
+        {
+            continue;
+        }
+        auto actual = yobot::unique_sdl_surface(SDL_DuplicateSurface(base.get()));
+        yobot::pixels::composite(src.get(), srcRect, actual.get(), pos);
+        yobot::pixels::fill(actual.get(), fillRect, color);
+        auto same = true;
+        for (int y = 0; y < canvas.y; y++)
+        {
+            same = same && std::equal(PixelRow(actual.get(), y), PixelRow(actual.get(), y) + canvas.x, PixelRow(expected.get(), y));
+        }
+        exact = exact && same;
+        Measure(std::format("composite {}", name), 200, 1, [&](std::size_t) {
+            yobot::pixels::composite(src.get(), srcRect, actual.get(), pos);
+        }, same ? "exact" : "MISMATCH");
+        Measure(std::format("fill {}", name), 200, 1, [&](std::size_t) {
+            yobot::pixels::fill(actual.get(), { 0, 0, canvas.x, canvas.y }, color);
+        });
+    }
+    yobot::pixels::select(selected);
+    return exact;
+}
+
+static int Micro(const std::filesystem::path& fixtureDir)
+{
+    if (!Pixels())
+    {
+        SPDLOG_ERROR("pixel kernels differ from SDL");
+        return 1;
+    }
+    fixtureServer fixture(fixtureDir);
+    auto base = fixture.start(0);
+    auto hosts = yobot::UpstreamHosts{ base, base };
+    yobot::paintPool pool(1, 4);
+
+    json bossData;
+    std::vector<double> cold(1);
+    auto start = Clock::now();
+    yobot::updateBossData(bossData, hosts);
+    cold[0] = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    Report("updateBossData cold", cold);
+    Measure("updateBossData 304", 20, 1, [&](std::size_t) {
+        yobot::updateBossData(bossData, hosts);
+    });
+    Measure("compileBossData", 200, 1, [&](std::size_t i) {
+        yobot::compileBossData(bossData, i + 1);
+    });
+    auto snapshot = yobot::compileBossData(bossData, 1);
+    auto areaData = snapshot->find(yobot::area::cn);
+    if (!areaData)
+    {
+        SPDLOG_ERROR("no boss data from the fixture");
+        return 1;
+    }
+    std::int64_t sink = 0;
+    Measure("getPhase", 1000, 64, [&](std::size_t i) {
+        sink += areaData->getPhase((std::int64_t)(i % 60));
+    });
+
+    std::vector<std::string> jsonBodies, cborBodies, msgpackBodies;
+    for (std::size_t i = 0; i < 64; i++)
+    {
+        auto body = json(SampleStatus(i));
+        jsonBodies.push_back(body.dump());
+        auto cbor = json::to_cbor(body);
+        cborBodies.emplace_back(cbor.begin(), cbor.end());
+        auto msgpack = json::to_msgpack(body);
+        msgpackBodies.emplace_back(msgpack.begin(), msgpack.end());
+    }
+    yobot::ClanStatus parsed;
+    Measure("parse json DOM", 2000, 16, [&](std::size_t i) {
+        parsed = ParseStatusDOM(jsonBodies[i % jsonBodies.size()]);
+    });
+    Measure("parse json SAX", 2000, 16, [&](std::size_t i) {
+        yobot::parseClanStatus(jsonBodies[i % jsonBodies.size()], json::input_format_t::json, parsed);
+    });
+    Measure("parse cbor SAX", 2000, 16, [&](std::size_t i) {
+        yobot::parseClanStatus(cborBodies[i % cborBodies.size()], json::input_format_t::cbor, parsed);
+    });
+    Measure("parse msgpack SAX", 2000, 16, [&](std::size_t i) {
+        yobot::parseClanStatus(msgpackBodies[i % msgpackBodies.size()], json::input_format_t::msgpack, parsed);
+    });
+    Measure("prepareRenderData", 2000, 16, [&](std::size_t i) {
+        sink += std::get<0>(yobot::prepareRenderData(SampleStatus(i), *areaData));
+    });
+    Measure("makeRenderKey", 2000, 16, [&](std::size_t i) {
+        auto renderData = yobot::prepareRenderData(SampleStatus(i), *areaData);
+        sink += yobot::makeRenderKey(1, yobot::area::cn, renderData, yobot::ImageFormat::PNG, yobot::LayoutKind::STANDARD, yobot::Scale::ONE).lap;
+    });
+
+    auto steady = true;
+    pool.postDrawProcess([&](yobot::paint& context) {
+        yobot::ensurePanel(context, *snapshot, yobot::area::cn);
+        // Every iteration changes its band so the dirty tracking cannot skip the work.
+        Measure("refreshBackground", 200, 1, [&](std::size_t i) {
+            context.refreshBackground(yobot::area::cn, 'A' + i % 2);
+        });
+        Measure("refreshTotalProgress", 200, 1, [&](std::size_t i) {
+            context.refreshTotalProgress('A', { { {86400 * 5 - i * 3600, 86400 * 6}, {i % 3 + 1, 3} } });
+        });
+        Measure("refreshBossProgress", 200, 1, [&](std::size_t i) {
+            auto renderData = yobot::prepareRenderData(SampleStatus(i), *areaData);
+            context.refreshBossProgress(std::get<0>(renderData), std::get<1>(renderData), std::get<4>(renderData));
+        });
+        Measure("canvas flush", 200, 1, [&](std::size_t) {
+            context.canvas();
+        });
+        for (auto&& format : yobot::imageFormat::all)
+        {
+            std::string body;
+            yobot::encoder::getInstance().encode(format, context.canvas(), body);
+            Measure(std::format("encode {}", yobot::imageFormat::name(format)), 100, 1, [&](std::size_t) {
+                yobot::encoder::getInstance().encode(format, context.canvas(), body);
+            }, std::format("bytes={}", body.size()));
+        }
+        steady = SteadyAllocations(context, *snapshot, *areaData);
+    }).get();
+    // Every scale draws natively on a context of its own, so the half size should cost about a quarter.
+    for (auto&& scale : yobot::scale::all)
+    {
+        pool.postDrawProcess([&](yobot::paint& context) {
+            std::string body;
+            Measure(std::format("drawProgress png x{}", yobot::scale::name(scale)), 200, 1, [&](std::size_t i) {
+                auto renderData = yobot::prepareRenderData(SampleStatus(i), *areaData);
+                auto key = yobot::makeRenderKey(1, yobot::area::cn, renderData, yobot::ImageFormat::PNG, yobot::LayoutKind::STANDARD, scale);
+                yobot::drawProgress(context, *snapshot, key, renderData, body);
+            });
+        }, scale).get();
+    }
+    // loadRes drew every sample text through each atlas and through TTF_Text; any difference is listed here.
+    std::size_t mismatches = 0;
+    for (auto&& scale : yobot::scale::all)
+    {
+        pool.postDrawProcess([&](yobot::paint& context) {
+            auto&& samples = context.atlasMismatches();
+            std::cout << std::format("{:<28} {} mismatches\n", std::format("glyph atlas x{}", yobot::scale::name(scale)), samples.size());
+            for (auto&& sample : samples)
+            {
+                std::cout << std::format("    \"{}\"\n", sample);
+            }
+            mismatches += samples.size();
+        }, scale).get();
+    }
+    if (!steady)
+    {
+        SPDLOG_ERROR("the warm render path still allocates");
+        return 1;
+    }
+    if (mismatches != 0)
+    {
+        SPDLOG_ERROR("glyph atlas output differs from TTF_Text");
+        return 1;
+    }
+    std::cout << std::format("fixture requests:{} sink:{}\n", fixture.requests(), sink + parsed.lap);
+    return 0;
+}
+
+static int Load(const std::string& url, std::size_t threads, std::size_t seconds, std::size_t distinct)
+{
+    std::vector<std::vector<double>> samples(threads);
+    std::atomic<std::uint64_t> errors = 0;
+    auto deadline = Clock::now() + std::chrono::seconds(seconds);
+    {
+        std::vector<std::jthread> workers;
+        for (std::size_t t = 0; t < threads; t++)
+        {
+            workers.emplace_back([&, t] {
+                httplib::Client client(url);
+                client.set_keep_alive(true);
+                for (std::size_t i = t; Clock::now() < deadline; i += threads)
+                {
+                    auto params = httplib::Params{ {"data", json(SampleStatus(i % distinct)).dump()}, {"area", "cn"} };
+                    auto start = Clock::now();
+                    auto result = client.Get("/progress", params, httplib::Headers{});
+                    samples[t].push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+                    if (!result || result->status != httplib::OK_200)
+                    {
+                        errors++;
+                    }
+                }
+            });
+        }
+    }
+    std::vector<double> nanos;
+    for (auto&& x : samples)
+    {
+        nanos.insert(nanos.end(), x.begin(), x.end());
+    }
+    if (nanos.empty())
+    {
+        SPDLOG_ERROR("no requests completed");
+        return 1;
+    }
+    Report("GET /progress", nanos, std::format("rps={:.0f} errors={}", nanos.size() / (double)seconds, errors.load()));
+    return errors == 0 ? 0 : 1;
+}
+
+static int Record(const std::filesystem::path& dir)
+{
+    std::filesystem::create_directories(dir / "icon");
+    httplib::Client bossDataClient(LiveBossDataHost);
+    httplib::Client iconClient(LiveIconHost);
+    bossDataClient.set_follow_location(true);
+    iconClient.set_follow_location(true);
+    for (auto&& area : yobot::area::all)
+    {
+        auto result = bossDataClient.Get(std::format("/api/Quest/GetClanBattleInfos?s={}", area));
+        if (!result || result->status != httplib::OK_200)
+        {
+            SPDLOG_ERROR("{} not recorded", area);
+            continue;
+        }
+        std::ofstream(dir / std::format("{}.json", area), std::ios::binary) << result->body;
+        auto battles = json::parse(result->body, nullptr, false);
+        if (!battles.is_array() || battles.empty())
+        {
+            continue;
+        }
+        for (auto&& phase : battles.back().value("phases", json::array()))
+        {
+            for (auto&& boss : phase.value("bosses", json::array()))
+            {
+                auto filename = std::format("{}.webp", boss.value("unitId", 0));
+                if (std::filesystem::exists(dir / "icon" / filename))
+                {
+                    continue;
+                }
+                if (auto icon = iconClient.Get("/icon/unit/" + filename); icon && icon->status == httplib::OK_200)
+                {
+                    std::ofstream(dir / "icon" / filename, std::ios::binary) << icon->body;
+                }
+            }
+        }
+        SPDLOG_INFO("{} recorded {} bytes", area, result->body.size());
+    }
+    return 0;
+}
+
+// Runs func in an empty temporary directory holding only the font and the default icon,
+// so the icons updateBossData writes never land in a real icon directory.
+template<typename Func>
+static int InScratchDir(Func&& func)
+{
+    if (!std::filesystem::exists(DefaultFontPath.data))
+    {
+        SPDLOG_ERROR("{} is missing; run from the server's directory once it has downloaded the font", DefaultFontPath.data);
+        return 1;
+    }
+    auto origin = std::filesystem::current_path();
+    auto scratch = std::filesystem::temp_directory_path() / std::format("yobot_bench-{}", Clock::now().time_since_epoch().count());
+    std::filesystem::create_directories(scratch / FontDir);
+    std::filesystem::create_directories(scratch / IconDir);
+    std::filesystem::copy_file(DefaultFontPath.data, scratch / DefaultFontPath.data);
+    if (std::filesystem::exists(DefaultIconPath.data))
+    {
+        std::filesystem::copy_file(DefaultIconPath.data, scratch / DefaultIconPath.data);
+    }
+    std::filesystem::current_path(scratch);
+    auto ret = func();
+    std::filesystem::current_path(origin);
+    std::error_code ec;
+    std::filesystem::remove_all(scratch, ec);
+    return ret;
+}
+
+int main(int argc, char const *argv[])
+{
+    std::vector<std::string_view> args(argv + 1, argv + argc);
+    auto arg = [&args](std::size_t i, std::string_view fallback) {
+        return i < args.size() ? args[i] : fallback;
+    };
+    auto number = [&arg](std::size_t i, std::size_t fallback) {
+        auto str = arg(i, "");
+        std::size_t value = fallback;
+        std::from_chars(str.data(), str.data() + str.size(), value);
+        return value;
+    };
+    auto command = arg(0, "micro");
+    // Before anything reaches SDL, so every block it frees came from these.
+    SDL_SetMemoryFunctions(CountedSDLMalloc, CountedSDLCalloc, CountedSDLRealloc, CountedSDLFree);
+    if (command == "micro")
+    {
+        auto fixtureDir = std::filesystem::absolute(arg(1, "fixture"));
+        return InScratchDir([&] { return Micro(fixtureDir); });
+    }
+    if (command == "fixture")
+    {
+        fixtureServer fixture(arg(1, "fixture"));
+        SPDLOG_INFO("fixture serving at {}", fixture.start((int)number(2, 9541)));
+        fixture.wait();
+        return 0;
+    }
+    if (command == "load" && args.size() > 1)
+    {
+        return Load(std::string(args[1]), std::max<std::size_t>(number(2, 8), 1), std::max<std::size_t>(number(3, 10), 1), std::max<std::size_t>(number(4, 64), 1));
+    }
+    if (command == "record" && args.size() > 1)
+    {
+        return Record(args[1]);
+    }
+    std::cerr << "usage: yobot_bench micro [fixtureDir] | fixture [fixtureDir] [port] | load <url> [threads] [seconds] [distinct] | record <fixtureDir>\n";
+    return 2;
+}
@@ -4,21 +4,18 @@
 #include <tbb/tbb.h>
 #include <spdlog/spdlog.h>
 #include "yobot_bossData.h"
+#include "yobot_metrics.h"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <istream>
+#include <streambuf>
+#include <thread>
 
 constexpr auto IconDir = "icon";
 
 namespace yobot {
-    using BossData = std::tuple<std::string_view, json::array_t, json::array_t, json::array_t, json::array_t, json::array_t>;
-
-    template<typename T, typename... Args>
-    static auto& GetThreadBuffers(Args&&... args)
-    {
-        static tbb::enumerable_thread_specific<T> buffers([...args = std::forward<Args>(args)]() {
-            return T(args...);
-        });
-        return buffers;
-    }
+    using BossData = std::tuple<std::string_view, json::array_t, json::array_t, json::array_t, json::array_t, json::array_t, std::string, std::string>;
 
     template<std::size_t N>
     static auto& GetLimitedArena()
@@ -27,59 +24,299 @@ namespace yobot {
         return arena;
     }
 
-    static std::int64_t toSeconds(const json &t)
+    static std::int64_t toSeconds(const std::string &t)
     {
         std::chrono::sys_time<std::chrono::seconds> ret;
-        std::istringstream(t.get<std::string>())
+        std::istringstream(t)
             >> std::chrono::parse("%FT%T%Ez", ret);
         return ret.time_since_epoch().count();
     }
 
-    static void fetchBossData(BossData& bossData, tbb::concurrent_unordered_set<json::number_integer_t>& idSet)
+    // Streambuf over response chunks handed across threads. The bounded queue
+    // keeps only a few chunks alive while the parser catches up.
+    class chunkPipe : public std::streambuf
     {
-        auto&& [itArea, itBossHP, itLapRange, itBossId, itBossName, itTimeRange] = bossData;
-        httplib::Client client("https://pcr.satroki.tech");
-        client.set_follow_location(true);
-        auto&& buff = GetThreadBuffers<std::string>().local();
-        auto result = client.Get("/api/Quest/GetClanBattleInfos?s=" + std::string(itArea), [&buff](const char* data, size_t data_length) {
-            buff.append(data, data_length);
+    public:
+        explicit chunkPipe(std::size_t capacity)
+            : m_closed(false)
+        {
+            m_queue.set_capacity(capacity);
+        }
+        void push(const char* data, std::size_t length)
+        {
+            if (length != 0)
+            {
+                m_queue.push(std::string(data, length));
+            }
+        }
+        void close()
+        {
+            m_queue.push(std::string());
+        }
+        void drain()
+        {
+            while (!m_closed)
+            {
+                underflow();
+            }
+        }
+    protected:
+        int_type underflow() override
+        {
+            if (m_closed)
+            {
+                return traits_type::eof();
+            }
+            m_queue.pop(m_chunk);
+            if (m_chunk.empty())
+            {
+                m_closed = true;
+                return traits_type::eof();
+            }
+            setg(m_chunk.data(), m_chunk.data(), m_chunk.data() + m_chunk.size());
+            return traits_type::to_int_type(m_chunk.front());
+        }
+    private:
+        tbb::concurrent_bounded_queue<std::string> m_queue;
+        std::string m_chunk;
+        bool m_closed;
+    };
+
+    struct ClanBattle
+    {
+        struct Boss
+        {
+            json::number_integer_t unitId;
+            std::string name;
+            json::number_integer_t hp;
+        };
+        struct Phase
+        {
+            json::number_integer_t lapFrom;
+            json::number_integer_t lapTo;
+            std::vector<Boss> bosses;
+        };
+        std::string startTime;
+        std::string endTime;
+        std::vector<Phase> phases;
+    };
+
+    // Keeps only the last element of the GetClanBattleInfos array, which is the
+    // current clan battle, and only the fields the snapshot needs.
+    class clanBattleSax : public nlohmann::json_sax<json>
+    {
+    public:
+        ClanBattle latest;
+        std::string error;
+    public:
+        bool null() override { return true; }
+        bool boolean(bool) override { return true; }
+        bool number_integer(number_integer_t val) override { return integer(val); }
+        bool number_unsigned(number_unsigned_t val) override { return integer((number_integer_t)val); }
+        bool number_float(number_float_t, const string_t&) override { return true; }
+        bool binary(binary_t&) override { return true; }
+        bool string(string_t& val) override
+        {
+            auto&& key = lastKey();
+            if (m_depth == BattleDepth && key == "startTime")
+            {
+                m_current.startTime = std::move(val);
+            }
+            else if (m_depth == BattleDepth && key == "endTime")
+            {
+                m_current.endTime = std::move(val);
+            }
+            else if (inBoss() && key == "name")
+            {
+                m_current.phases.back().bosses.back().name = std::move(val);
+            }
+            return true;
+        }
+        bool start_object(std::size_t) override
+        {
+            if (++m_depth >= m_keys.size())
+            {
+                return true;
+            }
+            m_keys[m_depth].clear();
+            if (m_depth == BattleDepth)
+            {
+                m_current = {};
+            }
+            else if (inPhase())
+            {
+                m_current.phases.emplace_back();
+            }
+            else if (inBoss())
+            {
+                m_current.phases.back().bosses.emplace_back();
+            }
+            return true;
+        }
+        bool end_object() override
+        {
+            if (m_depth == BattleDepth)
+            {
+                latest = std::move(m_current);
+            }
+            m_depth--;
+            return true;
+        }
+        bool start_array(std::size_t) override
+        {
+            if (++m_depth < m_keys.size())
+            {
+                m_keys[m_depth].clear();
+            }
+            return true;
+        }
+        bool end_array() override
+        {
+            m_depth--;
+            return true;
+        }
+        bool key(string_t& val) override
+        {
+            if (m_depth < m_keys.size())
+            {
+                m_keys[m_depth] = std::move(val);
+            }
+            return true;
+        }
+        bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& e) override
+        {
+            error = e.what();
+            return false;
+        }
+    private:
+        // Depth counts the open containers: [ { "phases": [ { "bosses": [ { ...
+        static constexpr std::size_t BattleDepth = 2;
+        static constexpr std::size_t PhaseDepth = 4;
+        static constexpr std::size_t BossDepth = 6;
+        const std::string& lastKey() const
+        {
+            return m_keys[std::min(m_depth, m_keys.size() - 1)];
+        }
+        bool inPhase() const
+        {
+            return m_depth == PhaseDepth && m_keys[BattleDepth] == "phases";
+        }
+        bool inBoss() const
+        {
+            return m_depth == BossDepth && m_keys[BattleDepth] == "phases" && m_keys[PhaseDepth] == "bosses";
+        }
+        bool integer(number_integer_t val)
+        {
+            auto&& key = lastKey();
+            if (inPhase() && key == "lapFrom")
+            {
+                m_current.phases.back().lapFrom = val;
+            }
+            else if (inPhase() && key == "lapTo")
+            {
+                m_current.phases.back().lapTo = val;
+            }
+            else if (inBoss() && key == "unitId")
+            {
+                m_current.phases.back().bosses.back().unitId = val;
+            }
+            else if (inBoss() && key == "hp")
+            {
+                m_current.phases.back().bosses.back().hp = val;
+            }
             return true;
+        }
+    private:
+        ClanBattle m_current;
+        std::array<std::string, BossDepth + 1> m_keys;
+        std::size_t m_depth = 0;
+    };
+
+    static const json& areaField(const json& bossData, std::string_view key, std::string_view gameServer)
+    {
+        static const json null;
+        auto it = bossData.find(key);
+        if (it == bossData.end())
+        {
+            return null;
+        }
+        auto jt = it->find(gameServer);
+        return jt == it->end() ? null : *jt;
+    }
+
+    static void fetchBossData(const std::string& host, BossData& bossData, tbb::concurrent_unordered_set<json::number_integer_t>& idSet)
+    {
+        auto&& [itArea, itBossHP, itLapRange, itBossId, itBossName, itTimeRange, itETag, itLastModified] = bossData;
+        httplib::Client client(host);
+        client.set_follow_location(true);
+        httplib::Headers headers;
+        if (!itETag.empty())
+        {
+            headers.emplace("If-None-Match", itETag);
+        }
+        if (!itLastModified.empty())
+        {
+            headers.emplace("If-Modified-Since", itLastModified);
+        }
+        auto fetchStart = std::chrono::steady_clock::now();
+        chunkPipe pipe(4);
+        clanBattleSax sax;
+        std::atomic<bool> parsed = true;
+        std::jthread parser([&] {
+            std::istream is(&pipe);
+            parsed = json::sax_parse(is, &sax);
+            pipe.drain();
+        });
+        auto result = client.Get("/api/Quest/GetClanBattleInfos?s=" + std::string(itArea), headers, [&](const char* data, size_t data_length) {
+            pipe.push(data, data_length);
+            return parsed.load();
         });
-        if (result && result->status == httplib::OK_200)
+        pipe.close();
+        parser.join();
+        if (auto fetchTime = metrics::getInstance().fetch(itArea))
         {
-            auto clanBattleInfo = json::parse(std::string_view(buff));
-            auto& lastInfo = *(clanBattleInfo.rbegin());
-            auto& phases = lastInfo["phases"];
-            if (phases.is_array())
+            fetchTime->observe(std::chrono::steady_clock::now() - fetchStart);
+        }
+        if (result && result->status == httplib::NotModified_304)
+        {
+            SPDLOG_INFO("{} not modified", itArea);
+        }
+        else if (result && result->status == httplib::OK_200 && !parsed)
+        {
+            SPDLOG_ERROR("{} {}", itArea, sax.error);
+        }
+        else if (result && result->status == httplib::OK_200)
+        {
+            itETag = result->get_header_value("ETag");
+            itLastModified = result->get_header_value("Last-Modified");
+            auto&& phases = sax.latest.phases;
+            if (!phases.empty())
             {
-                auto ait = phases.begin();
-                for (auto&& boss : (*ait)["bosses"])
+                for (auto&& boss : phases.front().bosses)
                 {
-                    auto id = boss["unitId"].get<json::number_integer_t>();
-                    idSet.insert(id);
-                    itBossId.emplace_back(id);
-                    itBossName.emplace_back(boss["name"]);
+                    idSet.insert(boss.unitId);
+                    itBossId.emplace_back(boss.unitId);
+                    itBossName.emplace_back(boss.name);
                 }
-                for (; ait != phases.end(); ait++)
+                for (auto&& phase : phases)
                 {
                     json::array_t bossHP;
-                    for (auto&& boss : (*ait)["bosses"])
+                    for (auto&& boss : phase.bosses)
                     {
-                        bossHP.emplace_back(boss["hp"]);
+                        bossHP.emplace_back(boss.hp);
                     }
                     itBossHP.emplace_back(std::move(bossHP));
-                    itLapRange.emplace_back(json::array({ (*ait)["lapFrom"], (*ait)["lapTo"] }));
+                    itLapRange.emplace_back(json::array({ phase.lapFrom, phase.lapTo }));
                 }
                 *(itLapRange.rbegin()->rbegin()) = 999;
-                itTimeRange = { toSeconds(lastInfo["startTime"]), toSeconds(lastInfo["endTime"]) };
+                itTimeRange = { toSeconds(sax.latest.startTime), toSeconds(sax.latest.endTime) };
             }
         }
-        buff.clear();
     }
 
-    static void fetchBossIcon(tbb::concurrent_unordered_set<json::number_integer_t>::range_type range)
+    static void fetchBossIcon(const std::string& host, tbb::concurrent_unordered_set<json::number_integer_t>::range_type range)
     {
-        httplib::Client client("https://redive.estertion.win");
+        httplib::Client client(host);
         client.set_follow_location(true);
         for (auto&& id : range)
         {
@@ -100,27 +337,51 @@ namespace yobot {
         }
     }
 
-    void updateBossData(json &bossData)
+    BossDataChanges updateBossData(json &bossData, const UpstreamHosts& hosts, std::span<const std::string_view> areas)
     {
-        std::array<yobot::BossData, 3> vBossData = { {
-            {area::cn, {}, {}, {}, {}, {}},
-            {area::tw, {}, {}, {}, {}, {}},
-            {area::jp, {}, {}, {}, {}, {}}
-        } };
+        std::vector<yobot::BossData> vBossData(areas.size());
         tbb::concurrent_unordered_set<json::number_integer_t> idSet;
-        GetLimitedArena<vBossData.size()>().execute([&] {
+        for (std::size_t i = 0; i < vBossData.size(); i++)
+        {
+            auto a = areas[i];
+            // Validators are only sent when the area's data is already held.
+            auto&& timeRange = areaField(bossData, "time_range", a);
+            auto&& etag = areaField(bossData, "etag", a);
+            auto&& lastModified = areaField(bossData, "last_modified", a);
+            vBossData[i] = { a, {}, {}, {}, {}, {},
+                timeRange.is_array() && etag.is_string() ? etag.get<std::string>() : std::string(),
+                timeRange.is_array() && lastModified.is_string() ? lastModified.get<std::string>() : std::string() };
+            for (auto&& id : areaField(bossData, "boss_id", a))
+            {
+                idSet.insert(id.get<json::number_integer_t>());
+            }
+        }
+        GetLimitedArena<area::all.size()>().execute([&] {
             tbb::parallel_for(std::size_t(0), vBossData.size(), [&](std::size_t it) {
-                fetchBossData(vBossData[it], idSet);
+                fetchBossData(hosts.bossData, vBossData[it], idSet);
             });
-            tbb::parallel_for(idSet.range(), [](auto&& range) {
-                fetchBossIcon(range);
+            tbb::parallel_for(idSet.range(), [&](auto&& range) {
+                fetchBossIcon(hosts.icon, range);
             });
         });
+        BossDataChanges changes;
         for (auto&& x : vBossData)
         {
-            auto&& [a, b, c, d, e, f] = x;
+            auto&& [a, b, c, d, e, f, g, h] = x;
+            if (f.empty())
+            {
+                continue;
+            }
+            auto&& etag = bossData["etag"][a];
+            auto&& lastModified = bossData["last_modified"][a];
+            if (etag != g || lastModified != h)
+            {
+                etag = g;
+                lastModified = h;
+                changes.validators = true;
+            }
             auto&& timeRange = bossData["time_range"][a];
-            if (!bossData.is_null() && !timeRange.is_null() && *timeRange.begin() == *f.begin())
+            if (!timeRange.is_null() && *timeRange.begin() == *f.begin())
             {
                 continue;
             }
@@ -129,21 +390,118 @@ namespace yobot {
             bossData["boss_id"][a] = d;
             bossData["boss_name"][a] = e;
             timeRange = f;
+            changes.data = true;
+        }
+        return changes;
+    }
+
+    bool loadBossData(json& bossData, const std::filesystem::path& path)
+    {
+        auto ifs = std::ifstream(path, std::ios::binary);
+        if (!ifs)
+        {
+            return false;
+        }
+        auto loaded = json::parse(ifs, nullptr, false);
+        if (loaded.is_discarded() || !loaded.is_object())
+        {
+            SPDLOG_WARN("{} is not a valid snapshot", path.generic_string());
+            return false;
+        }
+        bossData = std::move(loaded);
+        return true;
+    }
+
+    bool saveBossData(const json& bossData, const std::filesystem::path& path)
+    {
+        auto tmpPath = path;
+        tmpPath += ".tmp";
+        {
+            auto ofs = std::ofstream(tmpPath, std::ios::binary | std::ios::trunc);
+            ofs << bossData.dump();
+            if (!ofs)
+            {
+                return false;
+            }
         }
+        std::error_code ec;
+        std::filesystem::rename(tmpPath, path, ec);
+        return !ec;
     }
 
-    std::int8_t getPhase(const json& bossData, const std::int64_t lap, const std::string_view& gameServer)
+    static AreaSnapshot compileArea(const json& bossData, std::string_view gameServer)
     {
-        char ret = 0;
-        auto& phaseList = bossData["lap_range"][gameServer].get_ref<const json::array_t&>();
-        for (auto&& range : phaseList)
+        AreaSnapshot ret{};
+        auto&& timeRange = areaField(bossData, "time_range", gameServer);
+        auto&& lapRange = areaField(bossData, "lap_range", gameServer);
+        auto&& bossHP = areaField(bossData, "boss_hp", gameServer);
+        if (!timeRange.is_array() || !lapRange.is_array() || !bossHP.is_array() || lapRange.size() != bossHP.size())
         {
-            if (lap >= range[0] && lap <= range[1])
+            return ret;
+        }
+        ret.timeRange = { timeRange[0].get<std::int64_t>(), timeRange[1].get<std::int64_t>() };
+        ret.bossId = areaField(bossData, "boss_id", gameServer).get<std::array<std::uint64_t, 5>>();
+        ret.bossName = areaField(bossData, "boss_name", gameServer).get<std::array<std::string, 5>>();
+        for (std::size_t i = 0; i < lapRange.size(); i++)
+        {
+            ret.lapRange.emplace_back(lapRange[i][0].get<std::int64_t>(), lapRange[i][1].get<std::int64_t>());
+            ret.bossHP.emplace_back(bossHP[i].get<std::array<std::uint64_t, 5>>());
+        }
+        auto lastLap = ret.lapRange.empty() ? 0 : ret.lapRange.back().first;
+        ret.phaseByLap.resize(std::max<std::int64_t>(lastLap, 0) + 1);
+        for (std::int64_t lap = 0; lap <= lastLap; lap++)
+        {
+            std::int8_t phase = 0;
+            while (phase + 1 < (std::int8_t)ret.lapRange.size() && lap > ret.lapRange[phase].second)
             {
-                break;
+                phase++;
             }
-            ret++;
+            ret.phaseByLap[lap] = phase;
         }
         return ret;
     }
+
+    std::shared_ptr<BossSnapshot> compileBossData(const json& bossData, std::uint64_t generation)
+    {
+        auto ret = std::make_shared<BossSnapshot>();
+        ret->generation = generation;
+        for (std::size_t i = 0; i < area::all.size(); i++)
+        {
+            try
+            {
+                ret->areas[i] = compileArea(bossData, area::all[i]);
+            }
+            catch (const json::exception& e)
+            {
+                SPDLOG_ERROR("{} {}", area::all[i], e.what());
+            }
+        }
+        return ret;
+    }
+
+    bool AreaSnapshot::valid() const
+    {
+        return !lapRange.empty();
+    }
+
+    std::int8_t AreaSnapshot::getPhase(const std::int64_t lap) const
+    {
+        if (lap < 0)
+        {
+            return 0;
+        }
+        return lap < (std::int64_t)phaseByLap.size() ? phaseByLap[lap] : (std::int8_t)(lapRange.size() - 1);
+    }
+
+    const AreaSnapshot* BossSnapshot::find(std::string_view gameServer) const
+    {
+        for (std::size_t i = 0; i < area::all.size(); i++)
+        {
+            if (area::all[i] == gameServer)
+            {
+                return areas[i].valid() ? &areas[i] : nullptr;
+            }
+        }
+        return nullptr;
+    }
 }
\ No newline at end of file
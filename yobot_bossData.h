@@ -1,5 +1,13 @@
 #pragma once
 #include <nlohmann/json.hpp>
+#include <array>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
 
 using nlohmann::json;
 using nlohmann::ordered_json;
@@ -9,9 +17,68 @@ namespace yobot {
         constexpr std::string_view cn = "cn";
         constexpr std::string_view tw = "tw";
         constexpr std::string_view jp = "jp";
+        constexpr std::array<std::string_view, 3> all = { cn, tw, jp };
+
+        // Maps a request parameter onto one of the known areas.
+        constexpr std::optional<std::string_view> parse(std::string_view name)
+        {
+            for (auto&& x : all)
+            {
+                if (x == name)
+                {
+                    return x;
+                }
+            }
+            return std::nullopt;
+        }
     }
 
-    void updateBossData(json& bossData);
+    // Typed, immutable copy of one area's boss data.
+    struct AreaSnapshot
+    {
+        std::vector<std::array<std::uint64_t, 5>> bossHP;
+        std::vector<std::pair<std::int64_t, std::int64_t>> lapRange;
+        std::array<std::uint64_t, 5> bossId;
+        std::array<std::string, 5> bossName;
+        std::pair<std::int64_t, std::int64_t> timeRange;
+        // Phase of every lap up to the start of the last phase; later laps are in the last phase.
+        std::vector<std::int8_t> phaseByLap;
+
+        bool valid() const;
+        std::int8_t getPhase(const std::int64_t lap) const;
+    };
+
+    // Published as a whole through an atomic shared_ptr and never modified afterwards.
+    struct BossSnapshot
+    {
+        std::uint64_t generation;
+        std::array<AreaSnapshot, area::all.size()> areas;
+
+        const AreaSnapshot* find(std::string_view gameServer) const;
+    };
+
+    // Where boss data and unit icons are fetched from, e.g. "https://pcr.satroki.tech".
+    struct UpstreamHosts
+    {
+        std::string bossData;
+        std::string icon;
+    };
+
+    // What a fetch changed in bossData: the boss data of an area, or only the validators
+    // sent with the next conditional request, which still need saving.
+    struct BossDataChanges
+    {
+        bool data = false;
+        bool validators = false;
+    };
+
+    // Fetches and merges only the listed areas. Unchanged areas are detected with
+    // conditional requests (ETag / Last-Modified).
+    BossDataChanges updateBossData(json& bossData, const UpstreamHosts& hosts, std::span<const std::string_view> areas = area::all);
+
+    // Last good boss data on disk, so a restart can serve before the first fetch.
+    bool loadBossData(json& bossData, const std::filesystem::path& path);
+    bool saveBossData(const json& bossData, const std::filesystem::path& path);
 
-    std::int8_t getPhase(const json& bossData, const std::int64_t lap, const std::string_view& gameServer);
+    std::shared_ptr<BossSnapshot> compileBossData(const json& bossData, std::uint64_t generation);
 }
@@ -0,0 +1,367 @@
+#include "yobot_clanStore.h"
+#include "yobot_metrics.h"
+#include <algorithm>
+
+namespace yobot {
+
+    void to_json(json& j, const ClanStatus& status)
+    {
+        j = { {"lap", status.lap}, {"lap_flags", status.lapFlags}, {"boss_hps", status.bossHPs} };
+    }
+
+    // Decodes either one status object or, in batch mode, an array of them that
+    // may also carry an "area" each.
+    class clanStatusSax : public nlohmann::json_sax<json>
+    {
+    public:
+        clanStatusSax(std::vector<ClanStatusItem>& items, bool batch, std::size_t limit = 1)
+            : m_items(items)
+            , m_itemDepth(batch ? 2 : 1)
+            , m_limit(limit)
+        {
+        }
+        bool complete() const
+        {
+            return m_depth == 0 && !m_items.empty() && (m_itemDepth == 2 || m_items.size() == 1);
+        }
+        bool overflowed() const
+        {
+            return m_overflowed;
+        }
+    public:
+        bool null() override { return skipped(); }
+        bool boolean(bool val) override
+        {
+            if (m_depth == m_itemDepth + 1 && m_field == Field::LapFlags && m_flags < 5)
+            {
+                m_items.back().status.lapFlags[m_flags++] = val;
+                return true;
+            }
+            return skipped();
+        }
+        bool number_integer(number_integer_t val) override
+        {
+            return val >= 0 ? number_unsigned((number_unsigned_t)val) : integer(val);
+        }
+        bool number_unsigned(number_unsigned_t val) override
+        {
+            if (m_depth == m_itemDepth + 1 && m_field == Field::BossHPs && m_hps < 5)
+            {
+                m_items.back().status.bossHPs[m_hps++] = val;
+                return true;
+            }
+            return integer((number_integer_t)val);
+        }
+        bool number_float(number_float_t, const string_t&) override { return skipped(); }
+        bool string(string_t& val) override
+        {
+            if (m_depth == m_itemDepth && m_field == Field::Area)
+            {
+                m_items.back().area = area::parse(val);
+                return m_items.back().area.has_value();
+            }
+            return skipped();
+        }
+        bool binary(binary_t&) override { return skipped(); }
+        bool start_object(std::size_t) override
+        {
+            if (++m_depth == m_itemDepth)
+            {
+                if (m_items.size() == m_limit)
+                {
+                    m_overflowed = true;
+                    return false;
+                }
+                m_items.emplace_back();
+                m_field = Field::Other;
+                m_seen = 0;
+                m_flags = 0;
+                m_hps = 0;
+                return true;
+            }
+            return skipped();
+        }
+        bool end_object() override
+        {
+            // Every item must carry all of its fields.
+            if (m_depth-- == m_itemDepth)
+            {
+                return m_seen == AllFields && m_flags == 5 && m_hps == 5;
+            }
+            return true;
+        }
+        bool start_array(std::size_t elements) override
+        {
+            m_depth++;
+            if (m_depth == 1 && m_itemDepth == 2)
+            {
+                // CBOR and MessagePack announce the length up front; JSON passes -1.
+                m_overflowed = elements != (std::size_t)-1 && elements > m_limit;
+                return !m_overflowed;
+            }
+            return (m_depth == m_itemDepth + 1 && (m_field == Field::LapFlags || m_field == Field::BossHPs)) || skipped();
+        }
+        bool end_array() override
+        {
+            m_depth--;
+            return true;
+        }
+        bool key(string_t& val) override
+        {
+            if (m_depth != m_itemDepth)
+            {
+                return true;
+            }
+            m_field = val == "lap" ? Field::Lap
+                : val == "lap_flags" ? Field::LapFlags
+                : val == "boss_hps" ? Field::BossHPs
+                : val == "area" && m_itemDepth == 2 ? Field::Area
+                : Field::Other;
+            if (m_field != Field::Other && m_field != Field::Area)
+            {
+                m_seen |= 1 << (int)m_field;
+            }
+            return true;
+        }
+        bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override
+        {
+            return false;
+        }
+    private:
+        enum class Field
+        {
+            Lap,
+            LapFlags,
+            BossHPs,
+            Area,
+            Other,
+        };
+        static constexpr int AllFields = 0b111;
+        bool integer(number_integer_t val)
+        {
+            if (m_depth == m_itemDepth && m_field == Field::Lap)
+            {
+                m_items.back().status.lap = val;
+                return true;
+            }
+            return skipped();
+        }
+        // Values of unknown keys are ignored; anything else in a known field is malformed.
+        bool skipped() const
+        {
+            return m_depth > m_itemDepth && m_field == Field::Other
+                || m_depth == m_itemDepth && m_field == Field::Other && !m_items.empty();
+        }
+    private:
+        std::vector<ClanStatusItem>& m_items;
+        const std::size_t m_itemDepth;
+        const std::size_t m_limit;
+        bool m_overflowed = false;
+        Field m_field = Field::Other;
+        int m_seen = 0;
+        std::size_t m_depth = 0;
+        std::size_t m_flags = 0;
+        std::size_t m_hps = 0;
+    };
+
+    bool parseClanStatus(std::string_view data, json::input_format_t format, ClanStatus& status)
+    {
+        stageTimer timer(Stage::PARSE);
+        std::vector<ClanStatusItem> items;
+        clanStatusSax sax(items, false);
+        if (!json::sax_parse(data, &sax, format) || !sax.complete())
+        {
+            return false;
+        }
+        status = items.front().status;
+        return true;
+    }
+
+    BatchParse parseClanStatusBatch(std::string_view data, json::input_format_t format, std::size_t limit, std::vector<ClanStatusItem>& items)
+    {
+        stageTimer timer(Stage::PARSE);
+        items.clear();
+        clanStatusSax sax(items, true, limit);
+        if (json::sax_parse(data, &sax, format) && sax.complete())
+        {
+            return BatchParse::OK;
+        }
+        return sax.overflowed() ? BatchParse::TOO_LARGE : BatchParse::MALFORMED;
+    }
+
+    template<typename T>
+    static void GetOptional(const json& j, const char* key, std::optional<T>& value)
+    {
+        if (auto it = j.find(key); it != j.end())
+        {
+            value = it->get<T>();
+        }
+    }
+
+    void from_json(const json& j, ClanDelta& delta)
+    {
+        GetOptional(j, "lap", delta.lap);
+        GetOptional(j, "boss", delta.boss);
+        GetOptional(j, "hp", delta.hp);
+        GetOptional(j, "lap_flag", delta.lapFlag);
+    }
+
+    clanStore::clanStore(std::size_t maxClans, std::chrono::seconds idleTimeout)
+        : m_closed(false)
+        , m_maxClans(std::max<std::size_t>(maxClans, 1))
+        , m_idleTimeout(idleTimeout)
+    {
+    }
+
+    void clanStore::evict()
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto oldest = m_clans.end();
+        auto oldestTouched = std::chrono::steady_clock::time_point::max();
+        for (auto it = m_clans.begin(); it != m_clans.end();)
+        {
+            auto&& entry = it->second;
+            std::lock_guard lock(entry->mutex);
+            if (now - entry->touched >= m_idleTimeout)
+            {
+                entry->evicted = true;
+                entry->changed.notify_all();
+                it = m_clans.erase(it);
+                continue;
+            }
+            if (entry->touched < oldestTouched)
+            {
+                oldestTouched = entry->touched;
+                oldest = it;
+            }
+            ++it;
+        }
+        if (m_clans.size() >= m_maxClans && oldest != m_clans.end())
+        {
+            std::lock_guard lock(oldest->second->mutex);
+            oldest->second->evicted = true;
+            oldest->second->changed.notify_all();
+            m_clans.erase(oldest);
+        }
+    }
+
+    std::shared_ptr<clanStore::Clan> clanStore::get(const std::string& clan) const
+    {
+        std::shared_lock lock(m_mutex);
+        auto it = m_clans.find(clan);
+        return it == m_clans.end() ? nullptr : it->second;
+    }
+
+    std::uint64_t clanStore::put(const std::string& clan, std::string_view area, const ClanStatus& status)
+    {
+        auto entry = get(clan);
+        if (!entry)
+        {
+            std::unique_lock lock(m_mutex);
+            if (!m_clans.contains(clan) && m_clans.size() >= m_maxClans)
+            {
+                evict();
+            }
+            auto [it, inserted] = m_clans.try_emplace(clan, nullptr);
+            if (inserted)
+            {
+                it->second = std::make_shared<Clan>();
+                it->second->state = { area, status, 1 };
+                it->second->touched = std::chrono::steady_clock::now();
+                return 1;
+            }
+            entry = it->second;
+        }
+        std::lock_guard lock(entry->mutex);
+        entry->touched = std::chrono::steady_clock::now();
+        auto&& state = entry->state;
+        if (state.area != area || state.status != status)
+        {
+            state.area = area;
+            state.status = status;
+            state.version++;
+            entry->changed.notify_all();
+        }
+        return state.version;
+    }
+
+    std::optional<std::uint64_t> clanStore::apply(const std::string& clan, const ClanDelta& delta)
+    {
+        auto entry = get(clan);
+        if (!entry || ((delta.hp || delta.lapFlag) && (!delta.boss || *delta.boss >= 5)))
+        {
+            return std::nullopt;
+        }
+        std::lock_guard lock(entry->mutex);
+        entry->touched = std::chrono::steady_clock::now();
+        auto&& state = entry->state;
+        auto status = state.status;
+        if (delta.lap)
+        {
+            status.lap = *delta.lap;
+        }
+        if (delta.hp)
+        {
+            status.bossHPs[*delta.boss] = *delta.hp;
+        }
+        if (delta.lapFlag)
+        {
+            status.lapFlags[*delta.boss] = *delta.lapFlag;
+        }
+        if (status != state.status)
+        {
+            state.status = status;
+            state.version++;
+            entry->changed.notify_all();
+        }
+        return state.version;
+    }
+
+    std::optional<clanStore::State> clanStore::find(const std::string& clan) const
+    {
+        auto entry = get(clan);
+        if (!entry)
+        {
+            return std::nullopt;
+        }
+        std::lock_guard lock(entry->mutex);
+        entry->touched = std::chrono::steady_clock::now();
+        return entry->state;
+    }
+
+    std::optional<clanStore::State> clanStore::wait(const std::string& clan, std::uint64_t seen, std::chrono::milliseconds timeout) const
+    {
+        auto entry = get(clan);
+        if (!entry)
+        {
+            return std::nullopt;
+        }
+        std::unique_lock lock(entry->mutex);
+        entry->changed.wait_for(lock, timeout, [&] {
+            return m_closed || entry->evicted || entry->state.version != seen;
+        });
+        if (m_closed || entry->evicted)
+        {
+            return std::nullopt;
+        }
+        entry->touched = std::chrono::steady_clock::now();
+        return entry->state;
+    }
+
+    void clanStore::close()
+    {
+        m_closed = true;
+        std::shared_lock lock(m_mutex);
+        for (auto&& [clan, entry] : m_clans)
+        {
+            std::lock_guard clanLock(entry->mutex);
+            entry->changed.notify_all();
+        }
+    }
+
+    std::size_t clanStore::size() const
+    {
+        std::shared_lock lock(m_mutex);
+        return m_clans.size();
+    }
+}
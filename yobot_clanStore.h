@@ -0,0 +1,110 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "yobot_bossData.h"
+
+namespace yobot {
+
+    // What a client used to send as the data parameter of /progress.
+    struct ClanStatus
+    {
+        std::int64_t lap;
+        std::array<bool, 5> lapFlags;
+        std::array<std::uint64_t, 5> bossHPs;
+
+        bool operator==(const ClanStatus&) const = default;
+    };
+
+    void to_json(json& j, const ClanStatus& status);
+
+    // Decodes a status straight into the struct without building a DOM. JSON, CBOR and
+    // MessagePack share the same rules; returns false on anything malformed or incomplete.
+    bool parseClanStatus(std::string_view data, json::input_format_t format, ClanStatus& status);
+
+    struct ClanStatusItem
+    {
+        std::optional<std::string_view> area;
+        ClanStatus status;
+    };
+
+    enum class BatchParse
+    {
+        OK,
+        MALFORMED,
+        TOO_LARGE,
+    };
+
+    // A non-empty array of statuses, each of which may name its own area. Parsing stops
+    // as soon as the array turns out to hold more than limit items.
+    BatchParse parseClanStatusBatch(std::string_view data, json::input_format_t format, std::size_t limit, std::vector<ClanStatusItem>& items);
+
+    // A small change to a stored status; unset fields are left alone.
+    struct ClanDelta
+    {
+        std::optional<std::int64_t> lap;
+        std::optional<std::size_t> boss;
+        std::optional<std::uint64_t> hp;
+        std::optional<bool> lapFlag;
+    };
+
+    void from_json(const json& j, ClanDelta& delta);
+
+    // Per-clan status kept on the server. Every real change bumps the clan's
+    // version and wakes the subscribers waiting on it. Holds at most maxClans clans;
+    // a new one first evicts those idle for idleTimeout, then the least recently used.
+    class clanStore
+    {
+    public:
+        struct State
+        {
+            std::string_view area; // one of yobot::area::all
+            ClanStatus status;
+            std::uint64_t version;
+        };
+    public:
+        clanStore(std::size_t maxClans, std::chrono::seconds idleTimeout);
+        clanStore(clanStore&) = delete;
+        clanStore(clanStore&&) = delete;
+    public:
+        // Both return the version after the call.
+        std::uint64_t put(const std::string& clan, std::string_view area, const ClanStatus& status);
+        // Returns nullopt when the clan is unknown or the delta does not apply.
+        std::optional<std::uint64_t> apply(const std::string& clan, const ClanDelta& delta);
+        std::optional<State> find(const std::string& clan) const;
+        // Blocks until the clan's version differs from seen or the timeout passes.
+        // Returns nullopt when the clan is unknown or evicted, or the store has been closed.
+        std::optional<State> wait(const std::string& clan, std::uint64_t seen, std::chrono::milliseconds timeout) const;
+        void close();
+        std::size_t size() const;
+    private:
+        struct Clan
+        {
+            mutable std::mutex mutex;
+            mutable std::condition_variable changed;
+            State state;
+            // Last read or write; subscribers refresh it on every wakeup.
+            mutable std::chrono::steady_clock::time_point touched;
+            bool evicted = false;
+        };
+        std::shared_ptr<Clan> get(const std::string& clan) const;
+        // Makes room for one more clan; called with m_mutex held exclusively.
+        void evict();
+    private:
+        mutable std::shared_mutex m_mutex;
+        std::unordered_map<std::string, std::shared_ptr<Clan>> m_clans;
+        std::atomic<bool> m_closed;
+        const std::size_t m_maxClans;
+        const std::chrono::seconds m_idleTimeout;
+    };
+}
@@ -0,0 +1,463 @@
+#include "yobot_encoder.h"
+#include "yobot_arena.h"
+#include "yobot_paint.h"
+#include <spdlog/spdlog.h>
+#include <png.h>
+#include <zlib.h>
+#include <webp/encode.h>
+#include <algorithm>
+#include <chrono>
+#include <memory_resource>
+#include <ranges>
+#include <unordered_map>
+#include <vector>
+
+namespace yobot {
+
+    ImageFormat imageFormat::negotiate(std::string_view accept)
+    {
+        for (auto&& range : accept | std::views::split(','))
+        {
+            auto type = std::string_view(range.begin(), range.end());
+            type = type.substr(0, type.find(';'));
+            auto first = type.find_first_not_of(' ');
+            auto last = type.find_last_not_of(' ');
+            if (first == std::string_view::npos)
+            {
+                continue;
+            }
+            type = type.substr(first, last - first + 1);
+            for (std::size_t i = 0; i < all.size(); i++)
+            {
+                if (contentTypes[i] == type)
+                {
+                    return all[i];
+                }
+            }
+        }
+        return ImageFormat::PNG;
+    }
+
+    // Scratch of the encode running on this thread: libpng and zlib state, the PNG8
+    // histogram and index buffers. Workers are long-lived, so it warms up once per thread.
+    static arena& Scratch()
+    {
+        static thread_local arena instance;
+        return instance;
+    }
+
+    // Nearest palette entries for PNG8 colors outside the palette, memoized on 5-bit RGB and
+    // 2-bit alpha. Each entry carries the epoch of the encode that wrote it, so starting an
+    // encode only bumps the epoch instead of clearing the table.
+    struct NearestTable
+    {
+        static constexpr std::uint32_t EpochLimit = 1 << 24;
+        std::vector<std::uint32_t> entries = std::vector<std::uint32_t>(1 << 17);
+        std::uint32_t epoch = 0;
+
+        void nextEncode()
+        {
+            if (++epoch == EpochLimit)
+            {
+                std::ranges::fill(entries, 0);
+                epoch = 1;
+            }
+        }
+    };
+
+    static NearestTable& Nearest()
+    {
+        static thread_local NearestTable instance;
+        return instance;
+    }
+
+    encoder::encoder()
+        : m_counters()
+        , m_pngLevel(1)
+    {
+    }
+
+    encoder& encoder::getInstance()
+    {
+        static encoder instance{};
+        return instance;
+    }
+
+    void encoder::setPNGLevel(int level)
+    {
+        m_pngLevel = std::clamp(level, 0, 9);
+    }
+
+    bool encoder::encode(ImageFormat format, const SDL_Surface* surface, std::string& buff)
+    {
+        auto start = std::chrono::steady_clock::now();
+        // Every path reads B, G, R, A bytes; on little-endian hosts the ARGB8888 canvas already is.
+        unique_sdl_surface converted;
+        if (surface->format != SDL_PIXELFORMAT_BGRA32)
+        {
+            converted.reset(SDL_ConvertSurface(const_cast<SDL_Surface*>(surface), SDL_PIXELFORMAT_BGRA32));
+            if (!converted)
+            {
+                SPDLOG_ERROR("{}", SDL_GetError());
+                return false;
+            }
+            surface = converted.get();
+        }
+        buff.clear();
+        // Fresh buffers start at the size this format usually comes out at, instead of doubling up to it.
+        auto&& counter = m_counters[(std::size_t)format];
+        if (auto count = counter.count.load(); count != 0)
+        {
+            buff.reserve(counter.bytes / count * 5 / 4);
+        }
+        Scratch().reset();
+        bool ret = false;
+        switch (format)
+        {
+            case ImageFormat::PNG:
+                ret = encodePNG(surface, buff);
+                break;
+            case ImageFormat::PNG8:
+                ret = encodePNG8(surface, buff);
+                break;
+            case ImageFormat::QOI:
+                ret = encodeQOI(surface, buff);
+                break;
+            case ImageFormat::WEBP:
+                ret = encodeWebP(surface, buff);
+                break;
+        }
+        if (!ret)
+        {
+            SPDLOG_ERROR("failed to encode {}", imageFormat::name(format));
+            return false;
+        }
+        auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        counter.count++;
+        counter.bytes += buff.size();
+        counter.micros += cost.count();
+        return true;
+    }
+
+    void encoder::setPaletteSeeds(std::span<const SDL_Color> colors)
+    {
+        m_paletteSeeds.clear();
+        for (auto&& color : colors)
+        {
+            m_paletteSeeds.emplace_back((std::uint32_t)color.a << 24 | color.r << 16 | color.g << 8 | color.b);
+        }
+    }
+
+    encoder::Stats encoder::stats(ImageFormat format) const
+    {
+        auto&& counter = m_counters[(std::size_t)format];
+        return { counter.count, counter.bytes, counter.micros };
+    }
+
+    static void PNGWrite(png_structp png, png_bytep data, size_t length)
+    {
+        static_cast<std::string*>(png_get_io_ptr(png))->append((const char*)data, length);
+    }
+
+    static void PNGFlush(png_structp png)
+    {
+    }
+
+    static png_voidp PNGMalloc(png_structp png, png_alloc_size_t size)
+    {
+        return static_cast<arena*>(png_get_mem_ptr(png))->allocate(size, alignof(std::max_align_t));
+    }
+
+    static void PNGFree(png_structp png, png_voidp ptr)
+    {
+        static_cast<arena*>(png_get_mem_ptr(png))->deallocate(ptr, 0, alignof(std::max_align_t));
+    }
+
+    struct PNGImage
+    {
+        int w;
+        int h;
+        int colorType;
+        int filters;
+        const std::uint8_t* pixels;
+        std::ptrdiff_t pitch;
+        std::span<const png_color> palette;
+        std::span<const png_byte> alpha;
+    };
+
+    static bool WritePNG(const PNGImage& image, int level, std::string& buff)
+    {
+        auto png = png_create_write_struct_2(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr, &Scratch(), PNGMalloc, PNGFree);
+        auto info = png ? png_create_info_struct(png) : nullptr;
+        if (!info)
+        {
+            png_destroy_write_struct(&png, nullptr);
+            return false;
+        }
+        if (setjmp(png_jmpbuf(png)))
+        {
+            png_destroy_write_struct(&png, &info);
+            return false;
+        }
+        png_set_write_fn(png, &buff, PNGWrite, PNGFlush);
+        png_set_IHDR(png, info, image.w, image.h, 8, image.colorType,
+            PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        if (!image.palette.empty())
+        {
+            png_set_PLTE(png, info, image.palette.data(), (int)image.palette.size());
+        }
+        if (!image.alpha.empty())
+        {
+            png_set_tRNS(png, info, image.alpha.data(), (int)image.alpha.size(), nullptr);
+        }
+        // Long runs of flat fill: the filters turn them into zeros and RLE finds those quickly.
+        png_set_compression_level(png, level);
+        png_set_compression_strategy(png, Z_RLE);
+        png_set_filter(png, PNG_FILTER_TYPE_BASE, image.filters);
+        png_write_info(png, info);
+        if (image.colorType == PNG_COLOR_TYPE_RGB_ALPHA)
+        {
+            png_set_bgr(png);
+        }
+        for (int y = 0; y < image.h; y++)
+        {
+            png_write_row(png, image.pixels + y * image.pitch);
+        }
+        png_write_end(png, nullptr);
+        png_destroy_write_struct(&png, &info);
+        return true;
+    }
+
+    bool encoder::encodePNG(const SDL_Surface* surface, std::string& buff) const
+    {
+        auto image = PNGImage{ surface->w, surface->h, PNG_COLOR_TYPE_RGB_ALPHA, PNG_FILTER_SUB | PNG_FILTER_UP,
+            (const std::uint8_t*)surface->pixels, surface->pitch };
+        return WritePNG(image, m_pngLevel, buff);
+    }
+
+    static std::uint32_t PackBGRA(const std::uint8_t* bgra)
+    {
+        return (std::uint32_t)bgra[3] << 24 | bgra[2] << 16 | bgra[1] << 8 | bgra[0];
+    }
+
+    static std::uint32_t ColorDistance(std::uint32_t a, std::uint32_t b)
+    {
+        std::uint32_t sum = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            auto d = (int)(a >> shift & 0xff) - (int)(b >> shift & 0xff);
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    bool encoder::encodePNG8(const SDL_Surface* surface, std::string& buff) const
+    {
+        constexpr std::size_t PaletteSize = 256;
+        constexpr std::array<std::uint32_t, 5> CubeLevels = { 0, 64, 128, 191, 255 };
+        auto forEachRun = [surface](auto&& func) {
+            for (int y = 0; y < surface->h; y++)
+            {
+                auto row = (const std::uint8_t*)surface->pixels + (std::ptrdiff_t)y * surface->pitch;
+                for (int x = 0; x < surface->w;)
+                {
+                    auto color = PackBGRA(row + x * 4);
+                    int length = 1;
+                    while (x + length < surface->w && PackBGRA(row + (x + length) * 4) == color)
+                    {
+                        length++;
+                    }
+                    func(y, x, length, color);
+                    x += length;
+                }
+            }
+        };
+        // Flat fills collapse into a few runs, so the histogram stays cheap.
+        auto&& scratch = Scratch();
+        std::pmr::unordered_map<std::uint32_t, std::uint32_t> histogram(&scratch);
+        forEachRun([&](int, int, int length, std::uint32_t color) {
+            histogram[color] += length;
+        });
+        std::pmr::vector<std::uint32_t> palette(&scratch);
+        palette.reserve(PaletteSize);
+        auto addColor = [&palette](std::uint32_t color) {
+            if (palette.size() < PaletteSize && std::ranges::find(palette, color) == palette.end())
+            {
+                palette.emplace_back(color);
+            }
+        };
+        if (histogram.size() <= PaletteSize)
+        {
+            for (auto&& [color, count] : histogram)
+            {
+                addColor(color);
+            }
+        }
+        else
+        {
+            // Theme colors first, then the most frequent exact colors, then a coarse
+            // opaque cube for whatever the icons and antialiased edges leave over.
+            for (auto&& color : m_paletteSeeds)
+            {
+                if (histogram.contains(color))
+                {
+                    addColor(color);
+                }
+            }
+            std::pmr::vector<std::pair<std::uint32_t, std::uint32_t>> frequent(histogram.begin(), histogram.end(), &scratch);
+            auto frequentCount = std::min(frequent.size(), PaletteSize - CubeLevels.size() * CubeLevels.size() * CubeLevels.size());
+            std::ranges::partial_sort(frequent, frequent.begin() + frequentCount, std::ranges::greater{}, &std::pair<std::uint32_t, std::uint32_t>::second);
+            for (std::size_t i = 0; i < frequentCount; i++)
+            {
+                addColor(frequent[i].first);
+            }
+            for (auto&& r : CubeLevels)
+            {
+                for (auto&& g : CubeLevels)
+                {
+                    for (auto&& b : CubeLevels)
+                    {
+                        addColor(0xff000000 | r << 16 | g << 8 | b);
+                    }
+                }
+            }
+        }
+        // Translucent entries first keeps the tRNS chunk short.
+        auto opaque = std::ranges::stable_partition(palette, [](std::uint32_t color) { return color >> 24 != 0xff; });
+        auto translucentCount = (std::size_t)(opaque.begin() - palette.begin());
+        std::pmr::unordered_map<std::uint32_t, std::uint8_t> exact(&scratch);
+        std::pmr::vector<png_color> plte(&scratch);
+        std::pmr::vector<png_byte> trns(&scratch);
+        exact.reserve(palette.size());
+        plte.reserve(palette.size());
+        trns.reserve(translucentCount);
+        for (std::size_t i = 0; i < palette.size(); i++)
+        {
+            auto color = palette[i];
+            exact.emplace(color, (std::uint8_t)i);
+            plte.push_back({ (png_byte)(color >> 16), (png_byte)(color >> 8), (png_byte)color });
+            if (i < translucentCount)
+            {
+                trns.push_back((png_byte)(color >> 24));
+            }
+        }
+        auto&& nearest = Nearest();
+        nearest.nextEncode();
+        auto mapColor = [&](std::uint32_t color) -> std::uint8_t {
+            if (auto it = exact.find(color); it != exact.end())
+            {
+                return it->second;
+            }
+            auto key = (color >> 30) << 15 | (color >> 19 & 0x1f) << 10 | (color >> 11 & 0x1f) << 5 | (color >> 3 & 0x1f);
+            auto&& entry = nearest.entries[key];
+            if (entry >> 8 != nearest.epoch)
+            {
+                auto best = std::ranges::min_element(palette, {}, [color](std::uint32_t candidate) { return ColorDistance(color, candidate); });
+                entry = nearest.epoch << 8 | (std::uint32_t)(best - palette.begin());
+            }
+            return (std::uint8_t)entry;
+        };
+        std::pmr::vector<std::uint8_t> indices((std::size_t)surface->w * surface->h, &scratch);
+        forEachRun([&](int y, int x, int length, std::uint32_t color) {
+            std::fill_n(indices.begin() + (std::ptrdiff_t)y * surface->w + x, length, mapColor(color));
+        });
+        auto image = PNGImage{ surface->w, surface->h, PNG_COLOR_TYPE_PALETTE, PNG_FILTER_NONE,
+            indices.data(), surface->w, plte, trns };
+        return WritePNG(image, m_pngLevel, buff);
+    }
+
+    bool encoder::encodeQOI(const SDL_Surface* surface, std::string& buff)
+    {
+        struct Pixel
+        {
+            std::uint8_t r, g, b, a;
+            bool operator==(const Pixel&) const = default;
+        };
+        auto put32 = [&buff](std::uint32_t v) {
+            buff.push_back((char)(v >> 24));
+            buff.push_back((char)(v >> 16));
+            buff.push_back((char)(v >> 8));
+            buff.push_back((char)v);
+        };
+        buff.reserve(14 + (std::size_t)surface->w * surface->h + 8);
+        buff.append("qoif");
+        put32(surface->w);
+        put32(surface->h);
+        buff.push_back(4);
+        buff.push_back(0);
+        std::array<Pixel, 64> index{};
+        Pixel prev{ 0, 0, 0, 255 };
+        int run = 0;
+        for (int y = 0; y < surface->h; y++)
+        {
+            auto row = (const std::uint8_t*)surface->pixels + (std::ptrdiff_t)y * surface->pitch;
+            for (int x = 0; x < surface->w; x++)
+            {
+                auto bgra = row + x * 4;
+                Pixel px{ bgra[2], bgra[1], bgra[0], bgra[3] };
+                bool last = y == surface->h - 1 && x == surface->w - 1;
+                if (px == prev)
+                {
+                    if (++run == 62 || last)
+                    {
+                        buff.push_back((char)(0xc0 | (run - 1)));
+                        run = 0;
+                    }
+                    continue;
+                }
+                if (run > 0)
+                {
+                    buff.push_back((char)(0xc0 | (run - 1)));
+                    run = 0;
+                }
+                auto hash = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+                if (index[hash] == px)
+                {
+                    buff.push_back((char)hash);
+                }
+                else if (index[hash] = px; px.a == prev.a)
+                {
+                    auto dr = (std::int8_t)(px.r - prev.r);
+                    auto dg = (std::int8_t)(px.g - prev.g);
+                    auto db = (std::int8_t)(px.b - prev.b);
+                    auto drg = dr - dg;
+                    auto dbg = db - dg;
+                    if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2)
+                    {
+                        buff.push_back((char)(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                    }
+                    else if (drg > -9 && drg < 8 && dg > -33 && dg < 32 && dbg > -9 && dbg < 8)
+                    {
+                        buff.push_back((char)(0x80 | (dg + 32)));
+                        buff.push_back((char)((drg + 8) << 4 | (dbg + 8)));
+                    }
+                    else
+                    {
+                        buff.push_back((char)0xfe);
+                        buff.append({ (char)px.r, (char)px.g, (char)px.b });
+                    }
+                }
+                else
+                {
+                    buff.push_back((char)0xff);
+                    buff.append({ (char)px.r, (char)px.g, (char)px.b, (char)px.a });
+                }
+                prev = px;
+            }
+        }
+        buff.append({ 0, 0, 0, 0, 0, 0, 0, 1 });
+        return true;
+    }
+
+    bool encoder::encodeWebP(const SDL_Surface* surface, std::string& buff)
+    {
+        std::uint8_t* output = nullptr;
+        auto size = WebPEncodeLosslessBGRA((const std::uint8_t*)surface->pixels, surface->w, surface->h, surface->pitch, &output);
+        if (size != 0)
+        {
+            buff.assign((const char*)output, size);
+        }
+        WebPFree(output);
+        return size != 0;
+    }
+}
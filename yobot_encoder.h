@@ -0,0 +1,93 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <SDL3/SDL_surface.h>
+
+namespace yobot {
+
+    enum class ImageFormat : std::uint8_t
+    {
+        PNG,
+        PNG8,
+        QOI,
+        WEBP,
+    };
+
+    namespace imageFormat {
+        constexpr std::array all = { ImageFormat::PNG, ImageFormat::PNG8, ImageFormat::QOI, ImageFormat::WEBP };
+        constexpr std::array<std::string_view, all.size()> names = { "png", "png8", "qoi", "webp" };
+        constexpr std::array<std::string_view, all.size()> contentTypes = { "image/png", "image/png", "image/qoi", "image/webp" };
+
+        constexpr std::string_view name(ImageFormat format)
+        {
+            return names[(std::size_t)format];
+        }
+
+        constexpr std::string_view contentType(ImageFormat format)
+        {
+            return contentTypes[(std::size_t)format];
+        }
+
+        constexpr std::optional<ImageFormat> parse(std::string_view str)
+        {
+            for (std::size_t i = 0; i < all.size(); i++)
+            {
+                if (names[i] == str)
+                {
+                    return all[i];
+                }
+            }
+            return std::nullopt;
+        }
+
+        // The first media type of an Accept header that we can encode, PNG otherwise.
+        ImageFormat negotiate(std::string_view accept);
+    }
+
+    // Encodes rendered surfaces and keeps per-format time and size totals.
+    class encoder
+    {
+    private:
+        encoder();
+        ~encoder() = default;
+    public:
+        encoder(encoder&) = delete;
+        encoder(encoder&&) = delete;
+        static encoder& getInstance();
+    public:
+        struct Stats
+        {
+            std::uint64_t count;
+            std::uint64_t bytes;
+            std::uint64_t micros;
+        };
+    public:
+        // zlib level of the PNG path; the default favours speed over size.
+        void setPNGLevel(int level);
+        // Colors that always get a palette slot in PNG8, set once before serving.
+        void setPaletteSeeds(std::span<const SDL_Color> colors);
+        bool encode(ImageFormat format, const SDL_Surface* surface, std::string& buff);
+        Stats stats(ImageFormat format) const;
+    private:
+        bool encodePNG(const SDL_Surface* surface, std::string& buff) const;
+        bool encodePNG8(const SDL_Surface* surface, std::string& buff) const;
+        static bool encodeQOI(const SDL_Surface* surface, std::string& buff);
+        static bool encodeWebP(const SDL_Surface* surface, std::string& buff);
+    private:
+        struct Counter
+        {
+            std::atomic<std::uint64_t> count;
+            std::atomic<std::uint64_t> bytes;
+            std::atomic<std::uint64_t> micros;
+        };
+        std::array<Counter, imageFormat::all.size()> m_counters;
+        std::atomic<int> m_pngLevel;
+        std::vector<std::uint32_t> m_paletteSeeds;
+    };
+}
@@ -0,0 +1,162 @@
+#include "yobot_glyphAtlas.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <ranges>
+#include <vector>
+
+namespace yobot {
+
+    template<typename Func>
+    static void ForEachCodepoint(std::string_view text, Func&& func)
+    {
+        auto str = text.data();
+        auto len = text.size();
+        while (len != 0)
+        {
+            func(SDL_StepUTF8(&str, &len));
+        }
+    }
+
+    glyphAtlas::glyphAtlas()
+        : m_renderer(nullptr)
+        , m_texture(nullptr)
+        , m_height(0)
+        , m_lineSkip(0)
+        , m_center(false)
+    {
+    }
+
+    bool glyphAtlas::build(SDL_Renderer* renderer, TTF_Font* font, std::string_view vocabulary)
+    {
+        m_renderer = renderer;
+        m_glyphs.clear();
+        m_kernings.clear();
+        m_height = TTF_GetFontHeight(font);
+        m_lineSkip = TTF_GetFontLineSkip(font);
+        m_center = TTF_GetFontWrapAlignment(font) == TTF_HORIZONTAL_ALIGN_CENTER;
+        std::vector<std::pair<std::uint32_t, unique_sdl_surface>> surfaces;
+        int atlasWidth = 0, atlasHeight = 0;
+        ForEachCodepoint(vocabulary, [&](std::uint32_t codepoint) {
+            if (codepoint == '\n' || m_glyphs.contains(codepoint))
+            {
+                return;
+            }
+            int minx, maxx, miny, maxy, advance;
+            auto surface = unique_sdl_surface(TTF_RenderGlyph_Blended(font, codepoint, SDL_Color{ 255,255,255,255 }));
+            if (!surface || !TTF_GetGlyphMetrics(font, codepoint, &minx, &maxx, &miny, &maxy, &advance))
+            {
+                return;
+            }
+            m_glyphs[codepoint] = { { (float)atlasWidth, 0.0f, (float)surface->w, (float)surface->h }, std::min(minx, 0), advance };
+            atlasWidth += surface->w;
+            atlasHeight = std::max(atlasHeight, surface->h);
+            surfaces.emplace_back(codepoint, std::move(surface));
+        });
+        for (auto&& [previous, a] : surfaces)
+        {
+            for (auto&& [codepoint, b] : surfaces)
+            {
+                int kern = 0;
+                if (TTF_GetGlyphKerning(font, previous, codepoint, &kern) && kern != 0)
+                {
+                    m_kernings[(std::uint64_t)previous << 32 | codepoint] = kern;
+                }
+            }
+        }
+        auto atlas = unique_sdl_surface(SDL_CreateSurface(std::max(atlasWidth, 1), std::max(atlasHeight, 1), SDL_PIXELFORMAT_ARGB8888));
+        for (auto&& [codepoint, surface] : surfaces)
+        {
+            auto&& src = m_glyphs[codepoint].src;
+            auto dst = SDL_Rect{ (int)src.x, (int)src.y, (int)src.w, (int)src.h };
+            SDL_SetSurfaceBlendMode(surface.get(), SDL_BLENDMODE_NONE);
+            SDL_BlitSurface(surface.get(), nullptr, atlas.get(), &dst);
+        }
+        m_texture.reset(SDL_CreateTextureFromSurface(renderer, atlas.get()));
+        SPDLOG_INFO("glyphs:{} atlas:{}x{}", m_glyphs.size(), atlasWidth, atlasHeight);
+        return m_texture != nullptr;
+    }
+
+    void glyphAtlas::clear()
+    {
+        m_texture = nullptr;
+        m_glyphs.clear();
+        m_kernings.clear();
+    }
+
+    const glyphAtlas::Glyph* glyphAtlas::find(std::uint32_t codepoint) const
+    {
+        auto it = m_glyphs.find(codepoint);
+        return it == m_glyphs.end() ? nullptr : &it->second;
+    }
+
+    int glyphAtlas::kerning(std::uint32_t previous, std::uint32_t codepoint) const
+    {
+        auto it = m_kernings.find((std::uint64_t)previous << 32 | codepoint);
+        return it == m_kernings.end() ? 0 : it->second;
+    }
+
+    int glyphAtlas::lineWidth(std::string_view line) const
+    {
+        int w = 0;
+        std::uint32_t previous = 0;
+        bool complete = true;
+        ForEachCodepoint(line, [&](std::uint32_t codepoint) {
+            auto glyph = find(codepoint);
+            if (!glyph)
+            {
+                complete = false;
+                return;
+            }
+            w += kerning(previous, codepoint) + glyph->advance;
+            previous = codepoint;
+        });
+        return complete ? w : -1;
+    }
+
+    bool glyphAtlas::measure(std::string_view text, int& w, int& h) const
+    {
+        if (!m_texture)
+        {
+            return false;
+        }
+        int lines = 0;
+        w = 0;
+        for (auto&& line : text | std::views::split('\n'))
+        {
+            auto lw = lineWidth(std::string_view(line.begin(), line.end()));
+            if (lw < 0)
+            {
+                return false;
+            }
+            w = std::max(w, lw);
+            lines++;
+        }
+        h = m_height + m_lineSkip * (lines - 1);
+        return true;
+    }
+
+    bool glyphAtlas::draw(std::string_view text, float x, float y) const
+    {
+        int w, h;
+        if (!measure(text, w, h))
+        {
+            return false;
+        }
+        for (auto&& range : text | std::views::split('\n'))
+        {
+            auto line = std::string_view(range.begin(), range.end());
+            auto penX = m_center ? x + (w - lineWidth(line)) / 2 : x;
+            std::uint32_t previous = 0;
+            ForEachCodepoint(line, [&](std::uint32_t codepoint) {
+                auto glyph = find(codepoint);
+                penX += kerning(previous, codepoint);
+                auto dst = SDL_FRect{ penX + glyph->offsetX, y, glyph->src.w, glyph->src.h };
+                SDL_RenderTexture(m_renderer, m_texture.get(), &glyph->src, &dst);
+                penX += glyph->advance;
+                previous = codepoint;
+            });
+            y += m_lineSkip;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string_view>
+#include <unordered_map>
+#include <SDL3/SDL_render.h>
+#include <SDL3_ttf/SDL_ttf.h>
+#include "yobot_paint.h"
+
+namespace yobot {
+
+    // Glyphs of a fixed vocabulary rasterized once into a single texture, so the
+    // hot path lays text out with plain texture copies instead of shaping it.
+    class glyphAtlas
+    {
+    public:
+        glyphAtlas();
+        glyphAtlas(glyphAtlas&) = delete;
+        glyphAtlas(glyphAtlas&&) = delete;
+    public:
+        bool build(SDL_Renderer* renderer, TTF_Font* font, std::string_view vocabulary);
+        // Drops the glyphs, so every text falls back to TTF_Text.
+        void clear();
+        // Both return false when the text holds a glyph outside the vocabulary.
+        bool measure(std::string_view text, int& w, int& h) const;
+        bool draw(std::string_view text, float x, float y) const;
+    private:
+        struct Glyph
+        {
+            SDL_FRect src;
+            int offsetX;
+            int advance;
+        };
+        const Glyph* find(std::uint32_t codepoint) const;
+        int kerning(std::uint32_t previous, std::uint32_t codepoint) const;
+        int lineWidth(std::string_view line) const;
+    private:
+        SDL_Renderer* m_renderer;
+        unique_sdl_texture m_texture;
+        std::unordered_map<std::uint32_t, Glyph> m_glyphs;
+        std::unordered_map<std::uint64_t, int> m_kernings;
+        int m_height;
+        int m_lineSkip;
+        bool m_center;
+    };
+}
@@ -0,0 +1,105 @@
+#include "yobot_iconCache.h"
+#include <spdlog/spdlog.h>
+#include <SDL3_image/SDL_image.h>
+#include <format>
+
+namespace yobot {
+
+    iconCache::iconCache()
+        : m_bytes(0)
+        , m_capacity(16 * 1024 * 1024)
+    {
+    }
+
+    iconCache& iconCache::getInstance()
+    {
+        static iconCache instance{};
+        return instance;
+    }
+
+    void iconCache::setCapacity(std::size_t bytes)
+    {
+        std::lock_guard lock(m_mutex);
+        m_capacity = bytes;
+    }
+
+    // Unit ids have six digits and icon sides stay below 4096, so both fit one key.
+    std::uint64_t iconCache::keyOf(std::uint64_t id, const SDL_Point& size)
+    {
+        return id << 24 | (std::uint64_t)(size.x & 0xfff) << 12 | (std::uint64_t)(size.y & 0xfff);
+    }
+
+    iconCache::Icon iconCache::load(std::uint64_t id, const SDL_Point& size)
+    {
+        auto path = std::format("{}/{:06}.webp", IconDir, id);
+        auto decoded = unique_sdl_surface(IMG_Load(path.c_str()));
+        if (!decoded)
+        {
+            SPDLOG_WARN("{} {}", path, SDL_GetError());
+            return nullptr;
+        }
+        auto converted = unique_sdl_surface(SDL_ConvertSurface(decoded.get(), SDL_PIXELFORMAT_ARGB8888));
+        if (!converted)
+        {
+            return nullptr;
+        }
+        auto scaled = converted->w == size.x && converted->h == size.y
+            ? std::move(converted)
+            : unique_sdl_surface(SDL_ScaleSurface(converted.get(), size.x, size.y, SDL_SCALEMODE_LINEAR));
+        return Icon(scaled.release(), SDLSurfaceDeleter{});
+    }
+
+    std::size_t iconCache::sizeOf(const Icon& icon)
+    {
+        return icon ? (std::size_t)icon->pitch * icon->h : 0;
+    }
+
+    iconCache::Icon iconCache::get(std::uint64_t id, const SDL_Point& size)
+    {
+        auto key = keyOf(id, size);
+        {
+            std::lock_guard lock(m_mutex);
+            if (auto it = m_index.find(key); it != m_index.end())
+            {
+                m_entries.splice(m_entries.begin(), m_entries, it->second);
+                return it->second->second;
+            }
+        }
+        auto icon = load(id, size);
+        if (!icon)
+        {
+            return nullptr;
+        }
+        std::lock_guard lock(m_mutex);
+        if (auto it = m_index.find(key); it != m_index.end())
+        {
+            return it->second->second;
+        }
+        m_bytes += sizeOf(icon);
+        m_entries.emplace_front(key, icon);
+        m_index.emplace(key, m_entries.begin());
+        while (m_bytes > m_capacity && m_entries.size() > 1)
+        {
+            auto& last = m_entries.back();
+            m_bytes -= sizeOf(last.second);
+            m_index.erase(last.first);
+            m_entries.pop_back();
+        }
+        return icon;
+    }
+
+    void iconCache::warm(std::span<const std::uint64_t> ids, const SDL_Point& size)
+    {
+        for (auto&& id : ids)
+        {
+            get(id, size);
+        }
+        SPDLOG_INFO("icons:{} bytes:{}", ids.size(), bytes());
+    }
+
+    std::size_t iconCache::bytes() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_bytes;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include "yobot_paint.h"
+
+namespace yobot {
+
+    // Process-wide cache of unit icons, decoded once per size and pre-scaled to the
+    // icon size of the layout. Surfaces are shared read-only between paint contexts.
+    class iconCache
+    {
+    private:
+        iconCache();
+        ~iconCache() = default;
+    public:
+        iconCache(iconCache&) = delete;
+        iconCache(iconCache&&) = delete;
+        static iconCache& getInstance();
+    public:
+        using Icon = std::shared_ptr<SDL_Surface>;
+    public:
+        void setCapacity(std::size_t bytes);
+        Icon get(std::uint64_t id, const SDL_Point& size);
+        void warm(std::span<const std::uint64_t> ids, const SDL_Point& size);
+        std::size_t bytes() const;
+    private:
+        using Entry = std::pair<std::uint64_t, Icon>;
+        static std::uint64_t keyOf(std::uint64_t id, const SDL_Point& size);
+        static Icon load(std::uint64_t id, const SDL_Point& size);
+        static std::size_t sizeOf(const Icon& icon);
+    private:
+        mutable std::mutex m_mutex;
+        std::list<Entry> m_entries;
+        std::unordered_map<std::uint64_t, std::list<Entry>::iterator> m_index;
+        std::size_t m_bytes;
+        std::size_t m_capacity;
+    };
+}
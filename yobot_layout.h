@@ -0,0 +1,297 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <SDL3/SDL_pixels.h>
+#include <SDL3/SDL_rect.h>
+
+namespace yobot {
+
+    enum class LayoutKind : std::uint8_t
+    {
+        STANDARD,
+        COMPACT,
+        WIDE,
+    };
+
+    // Resolutions a layout is rendered at natively, for thumbnails and HiDPI screens.
+    enum class Scale : std::uint8_t
+    {
+        HALF,
+        ONE,
+        DOUBLE,
+    };
+
+    namespace scale {
+        constexpr std::array all = { Scale::HALF, Scale::ONE, Scale::DOUBLE };
+        constexpr std::array<std::string_view, all.size()> names = { "0.5", "1", "2" };
+        constexpr std::array<int, all.size()> percents = { 50, 100, 200 };
+
+        constexpr std::string_view name(Scale scale)
+        {
+            return names[(std::size_t)scale];
+        }
+
+        constexpr std::optional<Scale> parse(std::string_view str)
+        {
+            for (std::size_t i = 0; i < all.size(); i++)
+            {
+                if (names[i] == str)
+                {
+                    return all[i];
+                }
+            }
+            return std::nullopt;
+        }
+    }
+
+    enum class Theme : std::uint8_t
+    {
+        CLASSIC,
+        DARK,
+    };
+
+    namespace theme {
+        constexpr std::array all = { Theme::CLASSIC, Theme::DARK };
+        constexpr std::array<std::string_view, all.size()> names = { "classic", "dark" };
+
+        constexpr std::string_view name(Theme theme)
+        {
+            return names[(std::size_t)theme];
+        }
+
+        constexpr std::optional<Theme> parse(std::string_view str)
+        {
+            for (std::size_t i = 0; i < all.size(); i++)
+            {
+                if (names[i] == str)
+                {
+                    return all[i];
+                }
+            }
+            return std::nullopt;
+        }
+    }
+
+    // What a layout is derived from, specialized per canvas variant.
+    template<LayoutKind Kind>
+    struct layoutSpec;
+
+    template<>
+    struct layoutSpec<LayoutKind::STANDARD>
+    {
+        static constexpr SDL_Point canvas = { 480, 640 };
+        static constexpr SDL_Point margin = { 10, 30 };
+        static constexpr SDL_Point icon = { 80, 80 };
+        static constexpr SDL_Point lapBadge = { 72, 22 };
+        static constexpr int badgeInset = 4;
+        static constexpr float titleFont = 20.0f;
+        static constexpr float lapFont = 18.0f;
+        static constexpr float hpFont = 12.0f;
+    };
+
+    template<>
+    struct layoutSpec<LayoutKind::COMPACT>
+    {
+        static constexpr SDL_Point canvas = { 360, 480 };
+        static constexpr SDL_Point margin = { 8, 22 };
+        static constexpr SDL_Point icon = { 58, 58 };
+        static constexpr SDL_Point lapBadge = { 56, 18 };
+        static constexpr int badgeInset = 3;
+        static constexpr float titleFont = 16.0f;
+        static constexpr float lapFont = 14.0f;
+        static constexpr float hpFont = 10.0f;
+    };
+
+    template<>
+    struct layoutSpec<LayoutKind::WIDE>
+    {
+        static constexpr SDL_Point canvas = { 800, 540 };
+        static constexpr SDL_Point margin = { 10, 24 };
+        static constexpr SDL_Point icon = { 64, 64 };
+        static constexpr SDL_Point lapBadge = { 64, 20 };
+        static constexpr int badgeInset = 4;
+        static constexpr float titleFont = 18.0f;
+        static constexpr float lapFont = 16.0f;
+        static constexpr float hpFont = 12.0f;
+    };
+
+    // The colors of a layout, specialized per theme. Text stays white in every theme.
+    template<Theme T>
+    struct themeSpec;
+
+    template<>
+    struct themeSpec<Theme::CLASSIC>
+    {
+        static constexpr SDL_Color panel = { 255, 255, 255, 128 };
+        static constexpr SDL_Color shade = { 0, 0, 0, 128 };
+        static constexpr SDL_Color hp = { 192, 0, 0, 255 };
+        static constexpr std::array<SDL_Color, 2> lap = { SDL_Color{ 228, 94, 104, 255 }, SDL_Color{ 106, 152, 243, 255 } };
+        static constexpr std::array<SDL_Color, 5> phase = {
+            SDL_Color{ 132, 1, 244, 255 },
+            SDL_Color{ 115, 166, 231, 255 },
+            SDL_Color{ 206, 105, 165, 255 },
+            SDL_Color{ 206, 80, 66, 255 },
+            SDL_Color{ 181, 105, 206, 255 }
+        };
+    };
+
+    template<>
+    struct themeSpec<Theme::DARK>
+    {
+        static constexpr SDL_Color panel = { 24, 24, 28, 192 };
+        static constexpr SDL_Color shade = { 0, 0, 0, 160 };
+        static constexpr SDL_Color hp = { 214, 48, 48, 255 };
+        static constexpr std::array<SDL_Color, 2> lap = { SDL_Color{ 178, 58, 70, 255 }, SDL_Color{ 62, 104, 196, 255 } };
+        static constexpr std::array<SDL_Color, 5> phase = {
+            SDL_Color{ 66, 0, 122, 255 },
+            SDL_Color{ 57, 83, 115, 255 },
+            SDL_Color{ 103, 52, 82, 255 },
+            SDL_Color{ 103, 40, 33, 255 },
+            SDL_Color{ 90, 52, 103, 255 }
+        };
+    };
+
+    struct Palette
+    {
+        SDL_Color panel; // the clip area over the phase color
+        SDL_Color shade; // the margin, separators and empty bars
+        SDL_Color hp;
+        std::array<SDL_Color, 2> lap; // indexed by the lap flag
+        std::array<SDL_Color, 5> phase;
+    };
+
+    // Every rectangle of the canvas. Everything but canvas and clip is relative to clip.
+    struct Layout
+    {
+        struct Row
+        {
+            float separator; // y of the line above the row
+            SDL_FRect icon;
+            SDL_FRect hp;
+            SDL_FRect lap;
+            SDL_FRect lapText;
+            SDL_FRect band; // restored before the row is redrawn
+        };
+        SDL_Point canvas;
+        SDL_Rect clip;
+        SDL_FRect panel;
+        SDL_Point icon;
+        SDL_FRect phase;
+        // Full width of the schedule and lap bars; the filled part is right-aligned.
+        std::array<SDL_FRect, 2> progress;
+        SDL_FRect header; // restored before the header is redrawn
+        std::array<Row, 5> rows;
+        float titleFont;
+        float lapFont;
+        float hpFont;
+        Palette colors;
+    };
+
+    // Every length of the spec is scaled before anything is derived from it, so each
+    // scale gets whole-pixel geometry of its own rather than a resampled image.
+    template<LayoutKind Kind, Theme T = Theme::CLASSIC, int Percent = 100>
+    constexpr Layout makeLayout()
+    {
+        using Spec = layoutSpec<Kind>;
+        using Colors = themeSpec<T>;
+        constexpr auto s = [](SDL_Point p) { return SDL_Point{ p.x * Percent / 100, p.y * Percent / 100 }; };
+        constexpr auto m = s(Spec::margin);
+        constexpr auto canvas = s(Spec::canvas);
+        constexpr auto icon = s(Spec::icon);
+        constexpr auto lapBadge = s(Spec::lapBadge);
+        constexpr auto badgeInset = Spec::badgeInset * Percent / 100;
+        Layout ret{};
+        ret.canvas = canvas;
+        ret.clip = { m.x, m.y, canvas.x - m.x * 2, canvas.y - m.y * 2 };
+        ret.panel = { 0.0f, 0.0f, (float)ret.clip.w, (float)ret.clip.h };
+        ret.icon = icon;
+        auto iconW = (float)icon.x;
+        auto iconH = (float)icon.y;
+        auto rowH = iconH + m.x * 2;
+        auto hpX = m.x * 3 + iconW;
+        auto hpW = ret.panel.w - iconW - m.x * 4;
+        for (std::size_t i = 0; i < ret.rows.size(); i++)
+        {
+            auto&& row = ret.rows[i];
+            auto top = ret.panel.h - rowH * (ret.rows.size() - i);
+            row.separator = top;
+            row.icon = { (float)m.x, top + m.x, iconW, iconH };
+            row.hp = { hpX, top + m.x + iconH / 5 * 2, hpW, iconH / 4 };
+            row.lap = { hpX, top + m.x + badgeInset, (float)lapBadge.x, (float)lapBadge.y };
+            row.lapText = { row.lap.x + m.x / 2, row.lap.y, row.lap.w, row.lap.h };
+            row.band = { m.x + iconW, top, ret.panel.w - m.x - iconW, rowH };
+        }
+        auto headerH = ret.rows[0].separator;
+        ret.phase = { (float)m.x, (float)m.x, iconW, headerH - m.x * 2 };
+        for (std::size_t i = 0; i < ret.progress.size(); i++)
+        {
+            auto barH = ret.phase.h / 2;
+            ret.progress[i] = { hpX, ret.phase.y - m.x / 5 * 2 + (m.x / 5 * 4 + barH) * i, hpW, barH };
+        }
+        ret.header = { 0.0f, 0.0f, ret.panel.w, headerH };
+        ret.titleFont = Spec::titleFont * Percent / 100;
+        ret.lapFont = Spec::lapFont * Percent / 100;
+        ret.hpFont = Spec::hpFont * Percent / 100;
+        ret.colors = { Colors::panel, Colors::shade, Colors::hp, Colors::lap, Colors::phase };
+        return ret;
+    }
+
+    namespace layout {
+        constexpr std::array all = { LayoutKind::STANDARD, LayoutKind::COMPACT, LayoutKind::WIDE };
+        constexpr std::array<std::string_view, all.size()> names = { "standard", "compact", "wide" };
+
+        template<LayoutKind Kind, Theme T>
+        constexpr auto makeScales()
+        {
+            return []<std::size_t... I>(std::index_sequence<I...>) {
+                return std::array<Layout, sizeof...(I)>{ makeLayout<Kind, T, scale::percents[I]>()... };
+            }(std::make_index_sequence<scale::all.size()>());
+        }
+
+        template<Theme T>
+        constexpr auto makeKinds()
+        {
+            return std::array{ makeScales<LayoutKind::STANDARD, T>(), makeScales<LayoutKind::COMPACT, T>(), makeScales<LayoutKind::WIDE, T>() };
+        }
+
+        // Computed at compile time; render code only indexes into these.
+        constexpr std::array tables = { makeKinds<Theme::CLASSIC>(), makeKinds<Theme::DARK>() };
+        static_assert(tables.size() == theme::all.size() && tables[0].size() == all.size());
+
+        constexpr const Layout& get(LayoutKind kind, Scale scale = Scale::ONE, Theme theme = Theme::CLASSIC)
+        {
+            return tables[(std::size_t)theme][(std::size_t)kind][(std::size_t)scale];
+        }
+
+        // Whole pixels of a bar of width that are filled after done of total. Bars are drawn
+        // this wide, so a render key holding the count names exactly the pixels drawn.
+        constexpr std::uint64_t filledPixels(float width, std::uint64_t done, std::uint64_t total)
+        {
+            return total ? done * (std::uint64_t)width / total : 0;
+        }
+
+        constexpr std::optional<LayoutKind> parse(std::string_view str)
+        {
+            for (std::size_t i = 0; i < all.size(); i++)
+            {
+                if (names[i] == str)
+                {
+                    return all[i];
+                }
+            }
+            return std::nullopt;
+        }
+
+        static_assert(std::ranges::all_of(tables[0], [](auto&& scales) {
+            return std::ranges::all_of(scales, [](const Layout& x) { return x.phase.h > 0 && x.progress[1].y + x.progress[1].h <= x.header.h; });
+        }), "the rows leave no room for the header");
+        // The standard layout is the geometry the panel has always had.
+        static_assert(get(LayoutKind::STANDARD).phase.h == 60.0f && get(LayoutKind::STANDARD).rows[4].hp.y == 522.0f);
+        // Doubling is exact; the 2x image is the 1x one at twice the pixel density.
+        static_assert(get(LayoutKind::STANDARD, Scale::DOUBLE).canvas.x == 960 && get(LayoutKind::STANDARD, Scale::DOUBLE).rows[4].hp.y == 1044.0f);
+    }
+}
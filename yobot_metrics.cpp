@@ -0,0 +1,88 @@
+#include "yobot_metrics.h"
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <iterator>
+
+namespace yobot {
+
+    histogram::histogram()
+        : m_buckets()
+        , m_count(0)
+        , m_nanos(0)
+    {
+    }
+
+    void histogram::observe(std::chrono::nanoseconds elapsed)
+    {
+        auto nanos = (std::uint64_t)std::max<std::int64_t>(elapsed.count(), 0);
+        auto micros = (nanos + 999) / 1000;
+        // Bucket i holds everything up to 2^i microseconds.
+        auto index = micros <= 1 ? 0 : (std::size_t)std::bit_width(micros - 1);
+        if (index < BucketCount)
+        {
+            m_buckets[index].fetch_add(1, std::memory_order_relaxed);
+        }
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_nanos.fetch_add(nanos, std::memory_order_relaxed);
+    }
+
+    void histogram::write(std::string& out, std::string_view name, std::string_view labels) const
+    {
+        auto separator = labels.empty() ? "" : ",";
+        std::uint64_t cumulative = 0;
+        for (std::size_t i = 0; i < BucketCount; i++)
+        {
+            cumulative += m_buckets[i].load(std::memory_order_relaxed);
+            std::format_to(std::back_inserter(out), "{}_bucket{{{}{}le=\"{}\"}} {}\n", name, labels, separator, (double)(1ull << i) / 1e6, cumulative);
+        }
+        auto count = m_count.load(std::memory_order_relaxed);
+        std::format_to(std::back_inserter(out), "{}_bucket{{{}{}le=\"+Inf\"}} {}\n", name, labels, separator, count);
+        std::format_to(std::back_inserter(out), "{}_sum{{{}}} {}\n", name, labels, m_nanos.load(std::memory_order_relaxed) / 1e9);
+        std::format_to(std::back_inserter(out), "{}_count{{{}}} {}\n", name, labels, count);
+    }
+
+    metrics& metrics::getInstance()
+    {
+        static metrics instance{};
+        return instance;
+    }
+
+    histogram& metrics::stage(Stage stage)
+    {
+        return m_stages[(std::size_t)stage];
+    }
+
+    histogram* metrics::fetch(std::string_view gameServer)
+    {
+        for (std::size_t i = 0; i < area::all.size(); i++)
+        {
+            if (area::all[i] == gameServer)
+            {
+                return &m_fetches[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void metrics::write(std::string& out) const
+    {
+        out += "# HELP yobot_stage_seconds Time spent in each stage of serving a progress image.\n";
+        out += "# TYPE yobot_stage_seconds histogram\n";
+        for (std::size_t i = 0; i < stageNames.size(); i++)
+        {
+            m_stages[i].write(out, "yobot_stage_seconds", std::format("stage=\"{}\"", stageNames[i]));
+        }
+        out += "# HELP yobot_fetch_seconds Time spent fetching boss data per area.\n";
+        out += "# TYPE yobot_fetch_seconds histogram\n";
+        for (std::size_t i = 0; i < area::all.size(); i++)
+        {
+            m_fetches[i].write(out, "yobot_fetch_seconds", std::format("area=\"{}\"", area::all[i]));
+        }
+    }
+
+    void metrics::writeValue(std::string& out, std::string_view name, std::string_view type, double value)
+    {
+        std::format_to(std::back_inserter(out), "# TYPE {} {}\n{} {}\n", name, type, name, value);
+    }
+}
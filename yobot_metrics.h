@@ -0,0 +1,88 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "yobot_bossData.h"
+
+namespace yobot {
+
+    // Latency histogram with power-of-two microsecond buckets. Observing is a few
+    // relaxed atomic adds, so it is safe to call from every hot-path stage.
+    class histogram
+    {
+    public:
+        static constexpr std::size_t BucketCount = 26;
+    public:
+        histogram();
+        histogram(histogram&) = delete;
+        histogram(histogram&&) = delete;
+    public:
+        void observe(std::chrono::nanoseconds elapsed);
+        // Appends the _bucket, _sum and _count series in Prometheus text format.
+        void write(std::string& out, std::string_view name, std::string_view labels) const;
+    private:
+        std::array<std::atomic<std::uint64_t>, BucketCount> m_buckets;
+        std::atomic<std::uint64_t> m_count;
+        std::atomic<std::uint64_t> m_nanos;
+    };
+
+    enum class Stage : std::uint8_t
+    {
+        PARSE,
+        QUEUE,
+        DRAW,
+        FLUSH,
+        ENCODE,
+        TOTAL,
+    };
+
+    // Process-wide histograms of the render path and of boss data fetches.
+    class metrics
+    {
+    private:
+        metrics() = default;
+        ~metrics() = default;
+    public:
+        metrics(metrics&) = delete;
+        metrics(metrics&&) = delete;
+        static metrics& getInstance();
+    public:
+        static constexpr std::array<std::string_view, 6> stageNames = { "parse", "queue", "draw", "flush", "encode", "total" };
+    public:
+        histogram& stage(Stage stage);
+        // Nullptr for an unknown area.
+        histogram* fetch(std::string_view gameServer);
+        void write(std::string& out) const;
+        static void writeValue(std::string& out, std::string_view name, std::string_view type, double value);
+    private:
+        std::array<histogram, stageNames.size()> m_stages;
+        std::array<histogram, area::all.size()> m_fetches;
+    };
+
+    // Observes the time from construction to destruction into a histogram.
+    class stageTimer
+    {
+    public:
+        explicit stageTimer(histogram& target)
+            : m_target(target)
+            , m_start(std::chrono::steady_clock::now())
+        {
+        }
+        explicit stageTimer(Stage stage)
+            : stageTimer(metrics::getInstance().stage(stage))
+        {
+        }
+        ~stageTimer()
+        {
+            m_target.observe(std::chrono::steady_clock::now() - m_start);
+        }
+        stageTimer(stageTimer&) = delete;
+        stageTimer(stageTimer&&) = delete;
+    private:
+        histogram& m_target;
+        std::chrono::steady_clock::time_point m_start;
+    };
+}
@@ -1,353 +1,418 @@
 ﻿#include "yobot_paint.h"
+#include "yobot_glyphAtlas.h"
+#include "yobot_iconCache.h"
+#include "yobot_pixels.h"
 #include <spdlog/spdlog.h>
-#include <SDL3/SDL_init.h>
-#include <SDL3_image/SDL_image.h>
 #include <SDL3_ttf/SDL_ttf.h>
-#include <ranges>
-#include <future>
+#include <cstring>
+#include <span>
 
 namespace yobot {
 
-    enum class PaintEvent
-    {
-        MOUSE_BUTTON_UP = SDL_EVENT_MOUSE_BUTTON_UP,
-        QUIT = SDL_EVENT_QUIT,
-        DRAW_PROCESS = SDL_EVENT_USER + 1,
-    };
-
     using SDLIOStreamDeleter = GenericDeleter<SDL_IOStream, SDL_CloseIO>;
     using unique_sdl_iostream = std::unique_ptr<SDL_IOStream, SDLIOStreamDeleter>;
 
     using SDLTextDeleter = GenericDeleter<TTF_Text, TTF_DestroyText>;
     using unique_sdl_text = std::unique_ptr<TTF_Text, SDLTextDeleter>;
 
-    static bool SDLSetDrawColor(SDL_Renderer* renderer, const SDL_Color& color) noexcept
-    {
-        return SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
-    }
-
     static bool SDLSetTextColor(TTF_Text* text, const SDL_Color& color) noexcept
     {
         return TTF_SetTextColor(text, color.r, color.g, color.b, color.a);
     }
 
-    static SDL_FPoint GetCenterPos(TTF_Text* text, const SDL_FRect& rect)
+    static SDL_FPoint GetCenterPos(int w, int h, const SDL_FRect& rect)
     {
-        int w, h;
-        TTF_GetTextSize(text, &w, &h);
         return { SDL_roundf(rect.x + rect.w / 2 - w / 2.0f), SDL_roundf(rect.y + rect.h / 2 - h / 2.0f) };
     }
 
-    static SDL_FPoint GetLeftCenterPos(TTF_Text* text, const SDL_FRect& rect)
+    static SDL_FPoint GetLeftCenterPos(int w, int h, const SDL_FRect& rect)
     {
-        int w, h;
-        TTF_GetTextSize(text, &w, &h);
         return { SDL_roundf(rect.x), SDL_roundf(rect.y + rect.h / 2 - h / 2.0f) };
     }
 
+    // Integer rect of a fill inside the viewport, truncated like SDL's software renderer does.
+    static SDL_Rect ToCanvasRect(const SDL_FRect& rect, const SDL_Rect& viewport)
+    {
+        auto ret = SDL_Rect{ (int)rect.x + viewport.x, (int)rect.y + viewport.y, std::max((int)rect.w, 1), std::max((int)rect.h, 1) };
+        SDL_GetRectIntersection(&ret, &viewport, &ret);
+        return ret;
+    }
+
     static auto toOKFAILED(bool flag)
     {
         return flag ? "\033[1;32mOK\033[0m" : "\033[1;31mFAILED\033[0m";
     }
 
-    constexpr auto windowSize = SDL_Point{ 480,640 };
-    constexpr auto white = SDL_Color{ 255,255,255,128 };
-    constexpr auto halfTransparent = SDL_Color{ 0,0,0,128 };
+    // Everything else comes from the theme of the layout.
     constexpr auto transparent = SDL_Color{ 0,0,0,0 };
     constexpr auto black = SDL_Color{ 0,0,0,255 };
-    constexpr auto margin = SDL_Point{ 10,30 };
-    constexpr auto clipRect = SDL_Rect{ margin.x, margin.y, windowSize.x - margin.x * 2, windowSize.y - margin.y * 2 };
-    constexpr auto panelRect = SDL_FRect{ 0.0f,0.0f,(float)clipRect.w,(float)clipRect.h };
-    constexpr auto red = SDL_Color{ 192,0,0,255 };
     constexpr auto blue = SDL_Color{ 0,153,255,255 };
-    constexpr SDL_Color lapColor[] = { {228, 94, 104, 255}, {106, 152, 243, 255} };
-    constexpr SDL_Color phaseColor[] = { 
-        { 132, 1, 244, 255 }, 
-        { 115, 166, 231, 255 }, 
-        { 206, 105, 165, 255 }, 
-        { 206, 80, 66, 255 }, 
-        { 181, 105, 206, 255 }
+
+    constexpr auto titleVocabulary = std::string_view("0123456789/∞ABCDE阶段距离会战结束还剩天小时分钟秒");
+    constexpr auto lapVocabulary = std::string_view("0123456789周目");
+    constexpr auto hpVocabulary = std::string_view("0123456789/");
+
+    // Texts shaped like what the panels draw, covering every vocabulary glyph and the digit pairs kerning can touch.
+    constexpr std::string_view titleSamples[] = {
+        "阶段\nA", "阶段\nB", "阶段\nC", "阶段\nD", "阶段\nE",
+        "距离会战结束还剩12天", "距离会战结束还剩23小时", "距离会战结束还剩59分钟", "距离会战结束还剩8秒",
+        "∞", "10/45", "0123456789/9876543210"
     };
+    constexpr std::string_view lapSamples[] = { "周目1", "周目45", "周目0123456789", "周目9876543210" };
+    constexpr std::string_view hpSamples[] = { "0/1", "12345678/23456789", "0123456789/9876543210" };
+
+    static SDL_Color BlendColor(const SDL_Color& src, const SDL_Color& dst)
+    {
+        auto mix = [&src](Uint8 s, Uint8 d) {
+            return (Uint8)((s * src.a + d * (255 - src.a) + 127) / 255);
+        };
+        return { mix(src.r, dst.r), mix(src.g, dst.g), mix(src.b, dst.b), (Uint8)(src.a + (dst.a * (255 - src.a) + 127) / 255) };
+    }
+
+    std::vector<SDL_Color> paint::themeColors(Theme theme)
+    {
+        auto&& palette = layout::get(LayoutKind::STANDARD, Scale::ONE, theme).colors;
+        std::vector<SDL_Color> colors = { palette.panel, palette.shade, transparent, black, palette.hp, blue, palette.lap[0], palette.lap[1] };
+        for (auto&& color : palette.phase)
+        {
+            colors.emplace_back(color);
+            colors.emplace_back(BlendColor(palette.panel, color));
+            colors.emplace_back(BlendColor(palette.shade, color));
+        }
+        return colors;
+    }
 
-    paint::paint()
-        : m_window(nullptr)
+    paint::paint(LayoutKind kind, Scale scale, Theme theme)
+        : m_layout(layout::get(kind, scale, theme))
         , m_windowSurafce(nullptr)
         , m_renderer(nullptr)
         , m_textEngine(nullptr)
-        , m_panel(nullptr)
-        , m_texture0(nullptr)
+        , m_background(nullptr)
         , m_titleFont(nullptr)
         , m_lapFont(nullptr)
         , m_hpFont(nullptr)
+        , m_titleAtlas(std::make_unique<glyphAtlas>())
+        , m_lapAtlas(std::make_unique<glyphAtlas>())
+        , m_hpAtlas(std::make_unique<glyphAtlas>())
+        , m_phase(0)
     {
-        auto sdlInitRet = SDL_Init(SDL_INIT_VIDEO);
-        auto ttfInitRet = TTF_Init();
-        m_window.reset(SDL_CreateWindow(PROJECT_NAME, windowSize.x, windowSize.y, SDL_WINDOW_HIDDEN | SDL_WINDOW_TRANSPARENT));
-        if (m_window)
-        {
-            m_renderer.reset(SDL_CreateRenderer(m_window.get(), nullptr));
-        }
-        if (!m_renderer || std::string_view(SDL_GetRendererName(m_renderer.get())) == std::string_view("software"))
-        {
-            m_window = nullptr;
-            m_windowSurafce.reset(SDL_CreateSurface(windowSize.x, windowSize.y, SDL_PIXELFORMAT_ARGB8888));
-            m_renderer.reset(SDL_CreateSoftwareRenderer(m_windowSurafce.get()));
-        }
+        m_windowSurafce.reset(SDL_CreateSurface(m_layout.canvas.x, m_layout.canvas.y, SDL_PIXELFORMAT_ARGB8888));
+        m_renderer.reset(SDL_CreateSoftwareRenderer(m_windowSurafce.get()));
         m_textEngine.reset(TTF_CreateRendererTextEngine(m_renderer.get()));
-        SPDLOG_INFO("SDL_Init:{} TTF_Init:{} window:{} renderer:{}", toOKFAILED(sdlInitRet), toOKFAILED(ttfInitRet), SDL_GetWindowID(m_window.get()), SDL_GetRendererName(m_renderer.get()));
+        // Only text still goes through the renderer, and always inside the clip rect.
+        SDL_SetRenderViewport(m_renderer.get(), &m_layout.clip);
+        SPDLOG_INFO("canvas:{}x{} surface:{} renderer:{} textEngine:{} pixels:{}", m_layout.canvas.x, m_layout.canvas.y, toOKFAILED(m_windowSurafce != nullptr), SDL_GetRendererName(m_renderer.get()), toOKFAILED(m_textEngine != nullptr), pixels::isa());
     }
 
     paint::~paint()
     {
+        m_hpAtlas = nullptr;
+        m_lapAtlas = nullptr;
+        m_titleAtlas = nullptr;
         m_hpFont = nullptr;
         m_lapFont = nullptr;
         m_titleFont = nullptr;
-        m_texture0 = nullptr;
-        m_panel = nullptr;
+        m_background = nullptr;
+        m_panels.clear();
         m_textEngine = nullptr;
         m_renderer = nullptr;
         m_windowSurafce = nullptr;
-        m_window = nullptr;
-        TTF_Quit();
-        SDL_Quit();
-        SPDLOG_INFO("SDL_Quit");
-    }
-
-    paint& paint::getInstance()
-    {
-        static paint instance{};
-        return instance;
-    }
-
-    void paint::savePNGBuffer(unique_sdl_surface&& surface, std::string& buff)
-    {
-        auto ostream = SDL_IOFromDynamicMem();
-        IMG_SavePNG_IO(surface.get(), ostream, false);
-        auto props = SDL_GetIOProperties(ostream);
-        auto internal_ptr = (char*)SDL_GetPointerProperty(props, SDL_PROP_IOSTREAM_DYNAMIC_MEMORY_POINTER, nullptr);
-        buff.assign(internal_ptr, SDL_GetIOSize(ostream));
-        SDL_CloseIO(ostream);
     }
 
     paint& paint::loadRes()
     {
-        m_texture0.reset(IMG_LoadTexture(m_renderer.get(), DefaultIconPath.data));
-        auto font = unique_sdl_font(TTF_OpenFont(DefaultFontPath.data, 12));
+        auto font = unique_sdl_font(TTF_OpenFont(DefaultFontPath.data, m_layout.hpFont));
         TTF_SetFontHinting(font.get(), TTF_HINTING_LIGHT_SUBPIXEL);
         m_titleFont.reset(TTF_CopyFont(font.get()));
-        TTF_SetFontSize(m_titleFont.get(), 20);
+        TTF_SetFontSize(m_titleFont.get(), m_layout.titleFont);
         TTF_SetFontWrapAlignment(m_titleFont.get(), TTF_HORIZONTAL_ALIGN_CENTER);
         m_lapFont.reset(TTF_CopyFont(font.get()));
-        TTF_SetFontSize(m_lapFont.get(), 18);
+        TTF_SetFontSize(m_lapFont.get(), m_layout.lapFont);
         TTF_SetFontStyle(m_lapFont.get(), TTF_STYLE_BOLD);
         m_hpFont.reset(TTF_CopyFont(font.get()));
         TTF_SetFontStyle(m_hpFont.get(), TTF_STYLE_BOLD);
+        m_titleAtlas->build(m_renderer.get(), m_titleFont.get(), titleVocabulary);
+        m_lapAtlas->build(m_renderer.get(), m_lapFont.get(), lapVocabulary);
+        m_hpAtlas->build(m_renderer.get(), m_hpFont.get(), hpVocabulary);
+        auto verify = [this](glyphAtlas& atlas, TTF_Font* font, std::span<const std::string_view> samples, bool center) {
+            auto before = m_atlasMismatches.size();
+            for (auto&& sample : samples)
+            {
+                if (!matchesTTF(atlas, font, sample, center))
+                {
+                    SPDLOG_WARN("glyph atlas differs from TTF_Text on \"{}\", falling back to TTF_Text for this font", sample);
+                    m_atlasMismatches.emplace_back(sample);
+                }
+            }
+            if (m_atlasMismatches.size() != before)
+            {
+                atlas.clear();
+            }
+        };
+        verify(*m_titleAtlas, m_titleFont.get(), titleSamples, true);
+        verify(*m_lapAtlas, m_lapFont.get(), lapSamples, false);
+        verify(*m_hpAtlas, m_hpFont.get(), hpSamples, true);
         return *this;
     }
 
-    static unique_sdl_surface SaveSurface(SDL_Renderer* renderer)
+    const std::vector<std::string_view>& paint::atlasMismatches() const
+    {
+        return m_atlasMismatches;
+    }
+
+    bool paint::matchesTTF(const glyphAtlas& atlas, TTF_Font* font, std::string_view str, bool center)
     {
-        SDL_SetRenderViewport(renderer, nullptr);
-        return unique_sdl_surface(SDL_RenderReadPixels(renderer, nullptr));
+        auto surface = target();
+        pixels::fill(surface, { 0, 0, surface->w, surface->h }, transparent);
+        if (!drawAtlasText(atlas, str, m_layout.panel, center))
+        {
+            return true;
+        }
+        auto expected = unique_sdl_surface(SDL_DuplicateSurface(target()));
+        pixels::fill(surface, { 0, 0, surface->w, surface->h }, transparent);
+        drawTTFText(font, str, m_layout.panel, center);
+        surface = target();
+        auto same = true;
+        for (int y = 0; y < surface->h && same; y++)
+        {
+            auto row = static_cast<const std::byte*>(surface->pixels) + y * surface->pitch;
+            auto other = static_cast<const std::byte*>(expected->pixels) + y * expected->pitch;
+            same = std::memcmp(row, other, surface->w * sizeof(Uint32)) == 0;
+        }
+        // The canvas no longer holds any background.
+        m_background = nullptr;
+        m_phase = 0;
+        m_header.reset();
+        m_rows.fill(std::nullopt);
+        return same;
     }
 
-    static void ClearPanel(SDL_Renderer* renderer)
+    static void ClearPanel(SDL_Surface* surface, const Layout& layout)
     {
-        SDLSetDrawColor(renderer, halfTransparent);
-        SDL_RenderClear(renderer);
-        SDLSetDrawColor(renderer, white);
-        SDL_SetRenderViewport(renderer, &clipRect);
-        SDL_RenderFillRect(renderer, nullptr);
+        pixels::fill(surface, { 0, 0, surface->w, surface->h }, layout.colors.shade);
+        pixels::fill(surface, layout.clip, layout.colors.panel);
     }
 
-    static void RenderPanelRow(SDL_Renderer* renderer, SDL_FRect& iconRect, const uint64_t& id, SDL_FRect& HPRect)
+    static void RenderPanelRow(SDL_Surface* surface, const Layout& layout, const Layout::Row& row, const uint64_t& id)
     {
-        SDLSetDrawColor(renderer, halfTransparent);
-        iconRect.y -= (float)(iconRect.h + margin.x * 2);
-        SDL_RenderLine(renderer, panelRect.x, iconRect.y, panelRect.x + panelRect.w, iconRect.y);
-        iconRect.y += (float)margin.x;
-        auto path = std::format("icon/{:06}.webp", id);
-        auto texture = unique_sdl_texture(IMG_LoadTexture(renderer, path.c_str()));
-        SDL_RenderTexture(renderer, texture.get(), nullptr, &iconRect);
-        HPRect.y = iconRect.y + iconRect.h / 5 * 2;
-        SDL_RenderFillRect(renderer, &HPRect);
-        iconRect.y -= (float)margin.x;
-        auto lapRect = SDL_FRect{ HPRect.x, iconRect.y + margin.x + 4 , 18 * 4,22 };
-        SDLSetDrawColor(renderer, transparent);
-        SDL_RenderFillRect(renderer, &lapRect);
+        pixels::fill(surface, ToCanvasRect({ layout.panel.x, row.separator, layout.panel.w, 1.0f }, layout.clip), layout.colors.shade);
+        if (auto icon = iconCache::getInstance().get(id, layout.icon))
+        {
+            auto dst = ToCanvasRect(row.icon, layout.clip);
+            pixels::composite(icon.get(), { 0, 0, icon->w, icon->h }, surface, { dst.x, dst.y });
+        }
+        pixels::fill(surface, ToCanvasRect(row.hp, layout.clip), layout.colors.shade);
+        pixels::fill(surface, ToCanvasRect(row.lap, layout.clip), transparent);
     }
 
-    static void RenderPanelHeader(SDL_Renderer* renderer, TTF_TextEngine* textEngine, const SDL_FRect& iconRect, const SDL_FRect& HPRect)
+    static void RenderPanelHeader(SDL_Surface* surface, const Layout& layout)
     {
-        auto phaseRect = SDL_FRect{ iconRect.x, (float)(margin.x), iconRect.w, iconRect.y - margin.x * 2 };
-        SDLSetDrawColor(renderer, transparent);
-        SDL_RenderFillRect(renderer, &phaseRect);
-        auto progressRect = SDL_FRect{ HPRect.x, phaseRect.y - margin.x / 5 * 2, HPRect.w, phaseRect.h / 2 };
-        SDL_RenderFillRect(renderer, &progressRect);
-        progressRect.y += margin.x / 5 * 4 + progressRect.h;
-        SDL_RenderFillRect(renderer, &progressRect);
+        pixels::fill(surface, ToCanvasRect(layout.phase, layout.clip), transparent);
+        for (auto&& rect : layout.progress)
+        {
+            pixels::fill(surface, ToCanvasRect(rect, layout.clip), transparent);
+        }
     }
 
-    paint& paint::preparePanel(const std::array<std::uint64_t, 5>& iconIds)
+    paint& paint::preparePanel(std::string_view area, std::uint64_t generation, const std::array<std::uint64_t, 5>& iconIds)
     {
-        ClearPanel(m_renderer.get());
-        auto iconRect = SDL_FRect{ (float)margin.x,panelRect.h,(float)(m_texture0->w / 8 * 5),(float)(m_texture0->h / 8 * 5) };
-        auto HPRect = SDL_FRect{ margin.x * 3 + iconRect.w,0.0f,panelRect.w - iconRect.w - (float)(margin.x * 4),iconRect.h / 4 };
-        for (auto&& id : iconIds | std::views::reverse)
+        auto surface = target();
+        ClearPanel(surface, m_layout);
+        for (std::size_t i = 0; i < iconIds.size(); i++)
+        {
+            RenderPanelRow(surface, m_layout, m_layout.rows[i], iconIds[i]);
+        }
+        RenderPanelHeader(surface, m_layout);
+        auto panel = unique_sdl_surface(SDL_DuplicateSurface(surface));
+        if (auto it = m_panels.find(area); it != m_panels.end())
         {
-            RenderPanelRow(m_renderer.get(), iconRect, id, HPRect);
+            it->second = { std::move(panel), generation };
         }
-        RenderPanelHeader(m_renderer.get(), m_textEngine.get(), iconRect, HPRect);
-        m_panel.reset(SDL_CreateTextureFromSurface(m_renderer.get(), SaveSurface(m_renderer.get()).get()));
+        else
+        {
+            m_panels.emplace(area, Panel{ std::move(panel), generation });
+        }
+        m_background = nullptr;
+        m_phase = 0;
         return *this;
     }
 
-    paint& paint::refreshBackground(const char phase)
+    bool paint::hasPanel(std::string_view area, std::uint64_t generation) const
     {
-        SDL_SetRenderViewport(m_renderer.get(), nullptr);
-        SDLSetDrawColor(m_renderer.get(), phaseColor[phase - 'A']);
-        SDL_RenderClear(m_renderer.get());
-        SDL_RenderTexture(m_renderer.get(), m_panel.get(), nullptr, nullptr);
+        auto it = m_panels.find(area);
+        return it != m_panels.end() && it->second.generation == generation;
+    }
+
+    paint& paint::refreshBackground(std::string_view area, const char phase)
+    {
+        auto it = m_panels.find(area);
+        const SDL_Surface* panel = it != m_panels.end() ? it->second.surface.get() : nullptr;
+        if (panel == m_background && phase == m_phase)
+        {
+            return *this;
+        }
+        auto surface = target();
+        pixels::fill(surface, { 0, 0, surface->w, surface->h }, m_layout.colors.phase[phase - 'A']);
+        if (panel)
+        {
+            pixels::composite(panel, { 0, 0, panel->w, panel->h }, surface, { 0, 0 });
+        }
+        m_background = panel;
+        m_phase = phase;
+        m_header.reset();
+        m_rows.fill(std::nullopt);
         return *this;
     }
 
-    static std::string getCountDownStr(std::uint64_t t)
+    void paint::restoreBackground(const SDL_FRect& rect)
+    {
+        auto dst = SDL_Rect{ (int)(rect.x + m_layout.clip.x), (int)(rect.y + m_layout.clip.y), (int)rect.w, (int)rect.h };
+        auto surface = target();
+        pixels::fill(surface, dst, m_layout.colors.phase[m_phase - 'A']);
+        if (m_background)
+        {
+            pixels::composite(m_background, dst, surface, { dst.x, dst.y });
+        }
+    }
+
+    void paint::drawText(const glyphAtlas& atlas, TTF_Font* font, std::string_view str, const SDL_FRect& rect, bool center)
+    {
+        if (!drawAtlasText(atlas, str, rect, center))
+        {
+            drawTTFText(font, str, rect, center);
+        }
+    }
+
+    bool paint::drawAtlasText(const glyphAtlas& atlas, std::string_view str, const SDL_FRect& rect, bool center)
+    {
+        int w, h;
+        if (!atlas.measure(str, w, h))
+        {
+            return false;
+        }
+        auto pos = center ? GetCenterPos(w, h, rect) : GetLeftCenterPos(w, h, rect);
+        atlas.draw(str, pos.x, pos.y);
+        return true;
+    }
+
+    void paint::drawTTFText(TTF_Font* font, std::string_view str, const SDL_FRect& rect, bool center)
+    {
+        int w, h;
+        auto text = unique_sdl_text(TTF_CreateText(m_textEngine.get(), font, str.data(), str.length()));
+        TTF_GetTextSize(text.get(), &w, &h);
+        auto pos = center ? GetCenterPos(w, h, rect) : GetLeftCenterPos(w, h, rect);
+        TTF_DrawRendererText(text.get(), pos.x, pos.y);
+    }
+
+    CountDownText getCountDownStr(std::uint64_t t)
     {
         auto sec = std::chrono::seconds(t);
+        CountDownText ret;
         if (auto d = std::chrono::floor<std::chrono::days>(sec); d.count() != 0)
         {
-            return std::format("{}天", d.count());
+            return ret.format("{}天", d.count());
         }
         if (auto h = std::chrono::floor<std::chrono::hours>(sec); h.count() != 0)
         {
-            return std::format("{}小时", h.count());
+            return ret.format("{}小时", h.count());
         }
         if (auto m = std::chrono::floor<std::chrono::minutes>(sec); m.count() != 0)
         {
-            return std::format("{}分钟", m.count());
+            return ret.format("{}分钟", m.count());
         }
-        return std::format("{}秒", std::chrono::floor<std::chrono::seconds>(sec).count());
+        return ret.format("{}秒", std::chrono::floor<std::chrono::seconds>(sec).count());
+    }
+
+    std::uint64_t getCountDownTTL(std::uint64_t t)
+    {
+        for (std::uint64_t unit : { 86400, 3600, 60 })
+        {
+            if (t >= unit)
+            {
+                return t % unit + 1;
+            }
+        }
+        return 1;
     }
 
     paint& paint::refreshTotalProgress(const char phase, const std::array<Progress, 2>& progresses)
     {
-        auto iconRect = SDL_FRect{ (float)margin.x,panelRect.h,(float)(m_texture0->w / 8 * 5),(float)(m_texture0->h / 8 * 5) };
-        auto HPRect = SDL_FRect{ margin.x * 3 + iconRect.w,0.0f,panelRect.w - iconRect.w - (float)(margin.x * 4),iconRect.h / 4 };
-        auto phaseRect = SDL_FRect{ iconRect.x, (float)(margin.x), iconRect.w, iconRect.y - margin.x * 12 - iconRect.h * 5};
-        auto scheduleStr = "距离会战结束还剩" + getCountDownStr(progresses[0].first);
-        auto lapRangeStr = progresses[1].first == 0 ? "∞" : std::format("{}/{}", progresses[1].first, progresses[1].second);
-        auto phaseStr = std::format("阶段\n{}", phase);
-        auto phaseText = unique_sdl_text(TTF_CreateText(m_textEngine.get(), m_titleFont.get(), phaseStr.c_str(), phaseStr.length()));
-        std::array<unique_sdl_text, 2> texts{
-            unique_sdl_text(TTF_CreateText(m_textEngine.get(), m_titleFont.get(), scheduleStr.c_str(), scheduleStr.length())),
-            unique_sdl_text(TTF_CreateText(m_textEngine.get(), m_titleFont.get(), lapRangeStr.c_str(), lapRangeStr.length()))
-        };
-        std::array<SDL_FPoint, 2> textPositions;
-        std::array<SDL_FRect,2> rects;
+        // Text goes into fixed buffers so an unchanged header costs no allocation to detect.
+        HeaderState header{ phase };
+        header.schedule.format("距离会战结束还剩{}", getCountDownStr(progresses[0].first).view());
+        if (progresses[1].first == 0)
+        {
+            header.lapRange.format("∞");
+        }
+        else
+        {
+            header.lapRange.format("{}/{}", progresses[1].first, progresses[1].second);
+        }
+        auto rects = m_layout.progress;
         for (std::size_t i = 0; i < rects.size(); i++)
         {
-            rects[i].w = HPRect.w * (progresses[i].second - progresses[i].first) / progresses[i].second;
-            rects[i].x = HPRect.x + HPRect.w - rects[i].w;
-            rects[i].h = phaseRect.h / 2;
-            rects[i].y = phaseRect.y - margin.x / 5 * 2 + (margin.x / 5 * 4 + rects[i].h) * i;
-            textPositions[i] = GetCenterPos(texts[i].get(), { HPRect.x,rects[i].y,HPRect.w,rects[i].h });
+            rects[i].w = (float)layout::filledPixels(m_layout.progress[i].w, progresses[i].second - progresses[i].first, progresses[i].second);
+            rects[i].x = m_layout.progress[i].x + m_layout.progress[i].w - rects[i].w;
+        }
+        header.widths = { rects[0].w, rects[1].w };
+        if (m_header == header)
+        {
+            return *this;
         }
+        m_header = header;
 
-        SDL_SetRenderViewport(m_renderer.get(), &clipRect);
-        SDLSetDrawColor(m_renderer.get(), halfTransparent);
-        SDL_RenderFillRects(m_renderer.get(), rects.data(), (int)rects.size());
-        auto phasePos = GetCenterPos(phaseText.get(), phaseRect);
-        TTF_DrawRendererText(phaseText.get(), phasePos.x, phasePos.y);
-        for (std::size_t i = 0; i < texts.size(); i++)
+        TextBuffer<16> phaseStr;
+        phaseStr.format("阶段\n{}", phase);
+        restoreBackground(m_layout.header);
+        for (auto&& rect : rects)
         {
-            TTF_DrawRendererText(texts[i].get(), textPositions[i].x, textPositions[i].y);
+            pixels::fill(target(), ToCanvasRect(rect, m_layout.clip), m_layout.colors.shade);
         }
+        drawText(*m_titleAtlas, m_titleFont.get(), phaseStr.view(), m_layout.phase, true);
+        drawText(*m_titleAtlas, m_titleFont.get(), m_header->schedule.view(), m_layout.progress[0], true);
+        drawText(*m_titleAtlas, m_titleFont.get(), m_header->lapRange.view(), m_layout.progress[1], true);
         return *this;
     }
 
     paint& paint::refreshBossProgress(const std::uint64_t lap, const std::array<bool, 5>& lapFlags, const std::array<Progress, 5>& progresses)
     {
-        SDL_SetRenderViewport(m_renderer.get(), &clipRect);
-        auto iconRect = SDL_FRect{ (float)margin.x,panelRect.h,(float)(m_texture0->w / 8 * 5),(float)(m_texture0->h / 8 * 5) };
-        auto HPRect = SDL_FRect{ margin.x * 3 + iconRect.w,0.0f,panelRect.w - iconRect.w - (float)(margin.x * 4),iconRect.h / 4 };
-        auto HPTextMiddleX = HPRect.x + HPRect.w / 2;
-        auto HPText = unique_sdl_text(TTF_CreateText(m_textEngine.get(), m_hpFont.get(), nullptr, 0));
-        auto lapText = unique_sdl_text(TTF_CreateText(m_textEngine.get(), m_lapFont.get(), nullptr, 0));
         for (int i = 4; i >= 0; i--)
         {
-            iconRect.y -= (float)(iconRect.h + margin.x);
-            HPRect.y = iconRect.y + iconRect.h / 5 * 2;
-            SDLSetDrawColor(m_renderer.get(), halfTransparent);
-            SDL_RenderFillRect(m_renderer.get(), &HPRect);
-            auto HPProgress = HPRect;
+            auto row = RowState{ lap + lapFlags[i], lapFlags[i], progresses[i] };
+            if (m_rows[i] == row)
+            {
+                continue;
+            }
+            m_rows[i] = row;
+            auto&& rects = m_layout.rows[i];
+            // Text is queued in the renderer while fills go straight to the surface, so every
+            // fill goes through target(), which flushes the text drawn before it.
+            restoreBackground(rects.band);
+            pixels::fill(target(), ToCanvasRect(rects.hp, m_layout.clip), m_layout.colors.shade);
+            auto HPProgress = rects.hp;
             HPProgress.w = HPProgress.w / progresses[i].second * progresses[i].first;
             HPProgress.w = HPProgress.w < 1.0f && HPProgress.w > 0 ? 1.0f : HPProgress.w;
-            SDLSetDrawColor(m_renderer.get(), red);
-            SDL_RenderFillRect(m_renderer.get(), &HPProgress);
-            auto HPStr = std::format("{}/{}", progresses[i].first, progresses[i].second);
-            TTF_SetTextString(HPText.get(), HPStr.c_str(), HPStr.length());
-            auto pos = GetCenterPos(HPText.get(), HPRect);
-            TTF_DrawRendererText(HPText.get(), pos.x, pos.y);
-            iconRect.y -= (float)margin.x;
-            auto lapRect = SDL_FRect{ HPRect.x, iconRect.y + margin.x + 4 , 18 * 4,22 };
-            SDLSetDrawColor(m_renderer.get(), lapColor[lapFlags[i]]);
-            SDL_RenderFillRect(m_renderer.get(), &lapRect);
-            auto lapStr = std::format("周目{}", lap + lapFlags[i]);
-            TTF_SetTextString(lapText.get(), lapStr.c_str(), lapStr.length());
-            auto lapPos = GetLeftCenterPos(lapText.get(), lapRect);
-            TTF_DrawRendererText(lapText.get(), lapPos.x + margin.x / 2, lapPos.y);
+            pixels::fill(target(), ToCanvasRect(HPProgress, m_layout.clip), m_layout.colors.hp);
+            TextBuffer<48> HPStr;
+            HPStr.format("{}/{}", progresses[i].first, progresses[i].second);
+            drawText(*m_hpAtlas, m_hpFont.get(), HPStr.view(), rects.hp, true);
+            pixels::fill(target(), ToCanvasRect(rects.lap, m_layout.clip), m_layout.colors.lap[lapFlags[i]]);
+            TextBuffer<32> lapStr;
+            lapStr.format("周目{}", row.lap);
+            drawText(*m_lapAtlas, m_lapFont.get(), lapStr.view(), rects.lapText, false);
         }
         return *this;
     }
 
-    bool paint::show()
+    SDL_Surface* paint::target()
     {
-        return SDL_RenderPresent(m_renderer.get());
+        SDL_FlushRenderer(m_renderer.get());
+        return m_windowSurafce.get();
     }
 
-    void paint::mainLoop()
+    const SDL_Surface* paint::canvas()
     {
-        SDL_Event e{};
-        while (SDL_WaitEvent(&e))
-        {
-            switch ((PaintEvent)e.type)
-            {
-                case PaintEvent::DRAW_PROCESS:
-                {
-                    std::invoke(*(static_cast<std::function<void()>*>(e.user.data1)));
-                    static_cast<std::promise<unique_sdl_surface>*>(e.user.data2)->set_value(SaveSurface(m_renderer.get()));
-                    SDL_RenderPresent(m_renderer.get());
-                    break;
-                }
-                case PaintEvent::MOUSE_BUTTON_UP:
-                {
-                    break;
-                }
-                case PaintEvent::QUIT:
-                    return;
-                default:
-                    break;
-            }
-        }
-        SPDLOG_ERROR("{}", SDL_GetError());
+        return target();
     }
 
-    bool paint::postDrawProcess(std::function<void()>& process, std::promise<unique_sdl_surface>& promise)
-    {
-        SDL_Event e{
-            .user{
-                .type = (std::uint32_t)PaintEvent::DRAW_PROCESS,
-                .data1 = &process,
-                .data2 = &promise
-            },
-        };
-        return SDL_PushEvent(&e);
-    }
-
-    bool paint::postQuit()
-    {
-        SDL_Event e{ SDL_EVENT_QUIT };
-        return SDL_PushEvent(&e);
-    }
-    
 }
\ No newline at end of file
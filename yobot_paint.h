@@ -4,10 +4,13 @@
 #include <SDL3/SDL_render.h>
 #include <SDL3_ttf/SDL_textengine.h>
 #include <array>
+#include <map>
+#include <optional>
 #include <string>
-#include <future>
-#include <functional>
+#include <string_view>
+#include <vector>
 #include "tools.hpp"
+#include "yobot_layout.h"
 
 constexpr char IconDir[] = "icon";
 constexpr char FontDir[] = "font";
@@ -18,13 +21,14 @@ constexpr auto DefaultFontPath = FixedString(FontDir) + FixedString("/") + Fixed
 
 namespace yobot {
 
+    class glyphAtlas;
+
     using SDLSurfaceDeleter = GenericDeleter<SDL_Surface, SDL_DestroySurface>;
     using unique_sdl_surface = std::unique_ptr<SDL_Surface, SDLSurfaceDeleter>;
 
     using SDLTextureDeleter = GenericDeleter<SDL_Texture, SDL_DestroyTexture>;
     using unique_sdl_texture = std::unique_ptr<SDL_Texture, SDLTextureDeleter>;
 
-    using SDLWindowDeleter = GenericDeleter<SDL_Window, SDL_DestroyWindow>;
     using SDLRendererDeleter = GenericDeleter<SDL_Renderer, SDL_DestroyRenderer>;
     using SDLRendererTextEngineDeleter = GenericDeleter<TTF_TextEngine, TTF_DestroyRendererTextEngine>;
 
@@ -33,37 +37,85 @@ namespace yobot {
 
     using Progress = std::pair<std::uint64_t, std::uint64_t>;
 
+    // Room for any uint64 count of days with its unit.
+    using CountDownText = TextBuffer<24>;
+
+    CountDownText getCountDownStr(std::uint64_t t);
+    // Seconds until getCountDownStr(t) shows something else as t counts down.
+    std::uint64_t getCountDownTTL(std::uint64_t t);
+
+    // A self-contained render context: software surface, renderer, text engine,
+    // fonts and panel. Each instance must only be used from the thread that created it.
     class paint
     {
-    private:
-        paint();
-        ~paint();
     public:
+        explicit paint(LayoutKind kind = LayoutKind::STANDARD, Scale scale = Scale::ONE, Theme theme = Theme::CLASSIC);
+        ~paint();
         paint(paint&) = delete;
         paint(paint&&) = delete;
-        static paint& getInstance();
     public:
-        static void savePNGBuffer(unique_sdl_surface&& surface, std::string& buff);
+        // Flat colors the canvas is made of, as they end up after blending.
+        static std::vector<SDL_Color> themeColors(Theme theme);
     public:
+        // Also checks every atlas against TTF_Text and leaves the ones that differ unused.
         paint& loadRes();
-        paint& preparePanel(const std::array<std::uint64_t, 5>& iconIds);
-        paint& refreshBackground(const char phase);
+        paint& preparePanel(std::string_view area, std::uint64_t generation, const std::array<std::uint64_t, 5>& iconIds);
+        bool hasPanel(std::string_view area, std::uint64_t generation) const;
+        paint& refreshBackground(std::string_view area, const char phase);
         paint& refreshTotalProgress(const char phase, const std::array<Progress, 2>& progresses);
         paint& refreshBossProgress(const std::uint64_t lap, const std::array<bool, 5>& lapFlags, const std::array<Progress, 5>& progresses);
-        bool show();
-        void mainLoop();
-        bool postDrawProcess(std::function<void()>& process, std::promise<unique_sdl_surface>& promise);
-        bool postQuit();
+        // Flushes pending draws and returns the surface the software renderer draws
+        // into. It stays valid, and owned by this context, until the next draw.
+        const SDL_Surface* canvas();
+        // Sample texts whose atlas rendering differed from TTF_Text in loadRes.
+        const std::vector<std::string_view>& atlasMismatches() const;
+    private:
+        // Inputs of what is currently drawn on the canvas, so unchanged bands are skipped.
+        struct HeaderState
+        {
+            char phase;
+            TextBuffer<48> schedule;
+            TextBuffer<48> lapRange;
+            std::array<float, 2> widths;
+            bool operator==(const HeaderState&) const = default;
+        };
+        struct RowState
+        {
+            std::uint64_t lap;
+            bool lapFlag;
+            Progress progress;
+            bool operator==(const RowState&) const = default;
+        };
+        struct Panel
+        {
+            unique_sdl_surface surface;
+            std::uint64_t generation;
+        };
+        // Flushes queued renderer draws before the canvas is written directly.
+        SDL_Surface* target();
+        void restoreBackground(const SDL_FRect& rect);
+        void drawText(const glyphAtlas& atlas, TTF_Font* font, std::string_view str, const SDL_FRect& rect, bool center);
+        bool drawAtlasText(const glyphAtlas& atlas, std::string_view str, const SDL_FRect& rect, bool center);
+        void drawTTFText(TTF_Font* font, std::string_view str, const SDL_FRect& rect, bool center);
+        // Draws str both ways on a cleared canvas and compares the pixels.
+        bool matchesTTF(const glyphAtlas& atlas, TTF_Font* font, std::string_view str, bool center);
     private:
-        std::unique_ptr<SDL_Window, SDLWindowDeleter> m_window;
+        const Layout& m_layout;
         unique_sdl_surface m_windowSurafce;
         std::unique_ptr<SDL_Renderer, SDLRendererDeleter> m_renderer;
         std::unique_ptr<TTF_TextEngine, SDLRendererTextEngineDeleter> m_textEngine;
-        unique_sdl_texture m_panel;
-        unique_sdl_texture m_texture0;
+        std::map<std::string, Panel, std::less<>> m_panels;
+        const SDL_Surface* m_background;
         unique_sdl_font m_titleFont;
         unique_sdl_font m_lapFont;
         unique_sdl_font m_hpFont;
+        std::unique_ptr<glyphAtlas> m_titleAtlas;
+        std::unique_ptr<glyphAtlas> m_lapAtlas;
+        std::unique_ptr<glyphAtlas> m_hpAtlas;
+        char m_phase;
+        std::optional<HeaderState> m_header;
+        std::array<std::optional<RowState>, 5> m_rows;
+        std::vector<std::string_view> m_atlasMismatches;
     };
 }
 
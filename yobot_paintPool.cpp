@@ -0,0 +1,183 @@
+#include "yobot_paintPool.h"
+#include "yobot_metrics.h"
+#include <spdlog/spdlog.h>
+#include <SDL3/SDL_init.h>
+#include <SDL3/SDL_events.h>
+#include <SDL3_ttf/SDL_ttf.h>
+
+namespace yobot {
+
+    enum class PaintEvent
+    {
+        QUIT = SDL_EVENT_QUIT,
+    };
+
+    static auto toOKFAILED(bool flag)
+    {
+        return flag ? "\033[1;32mOK\033[0m" : "\033[1;31mFAILED\033[0m";
+    }
+
+    paintPool::paintPool(std::size_t workerCount, std::size_t queueDepth, LayoutKind kind, Theme theme)
+        : m_shed(0)
+    {
+        m_queue.set_capacity(std::max<std::size_t>(queueDepth, 1));
+        auto sdlInitRet = SDL_Init(SDL_INIT_EVENTS);
+        auto ttfInitRet = TTF_Init();
+        SPDLOG_INFO("SDL_Init:{} TTF_Init:{} workers:{} queueDepth:{} layout:{} theme:{}", toOKFAILED(sdlInitRet), toOKFAILED(ttfInitRet), workerCount, queueDepth, layout::names[(std::size_t)kind], theme::name(theme));
+        std::vector<std::promise<void>> ready(std::max<std::size_t>(workerCount, 1));
+        for (auto&& promise : ready)
+        {
+            m_workers.emplace_back([this, &promise, kind, theme] {
+                workerLoop(promise, kind, theme);
+            });
+        }
+        for (auto&& promise : ready)
+        {
+            promise.get_future().wait();
+        }
+    }
+
+    paintPool::~paintPool()
+    {
+        for (std::size_t i = 0; i < m_workers.size(); i++)
+        {
+            m_queue.push({});
+        }
+        m_workers.clear();
+        TTF_Quit();
+        SDL_Quit();
+        SPDLOG_INFO("SDL_Quit");
+    }
+
+    void paintPool::workerLoop(std::promise<void>& ready, LayoutKind kind, Theme theme)
+    {
+        // Every scale is ready before the pool is, so no request pays for loading fonts and atlases.
+        std::array<std::unique_ptr<paint>, scale::all.size()> contexts;
+        for (auto&& scale : scale::all)
+        {
+            contexts[(std::size_t)scale] = std::make_unique<paint>(kind, scale, theme);
+            contexts[(std::size_t)scale]->loadRes();
+        }
+        ready.set_value();
+        Job job;
+        while (true)
+        {
+            m_queue.pop(job);
+            if (!job.process)
+            {
+                break;
+            }
+            try
+            {
+                if (job.scale)
+                {
+                    std::invoke(job.process, *contexts[(std::size_t)*job.scale]);
+                }
+                else
+                {
+                    for (auto&& context : contexts)
+                    {
+                        std::invoke(job.process, *context);
+                    }
+                }
+            }
+            catch (const std::exception& e)
+            {
+                SPDLOG_ERROR("{}", e.what());
+            }
+            if (job.latch)
+            {
+                job.latch->arrive_and_wait();
+            }
+        }
+    }
+
+    std::future<void> paintPool::postDrawProcess(DrawProcess process, Scale scale)
+    {
+        auto drawPromise = std::make_shared<std::promise<void>>();
+        auto drawFuture = drawPromise->get_future();
+        auto queued = m_queue.try_push({ [process = std::move(process), drawPromise, queuedAt = std::chrono::steady_clock::now()](paint& context) {
+            metrics::getInstance().stage(Stage::QUEUE).observe(std::chrono::steady_clock::now() - queuedAt);
+            try
+            {
+                std::invoke(process, context);
+                drawPromise->set_value();
+            }
+            catch (...)
+            {
+                drawPromise->set_exception(std::current_exception());
+            }
+        }, scale });
+        if (!queued)
+        {
+            m_shed++;
+            return {};
+        }
+        return drawFuture;
+    }
+
+    void paintPool::broadcast(const DrawProcess& process)
+    {
+        // Every worker blocks on the latch after its share, so each one takes exactly one copy
+        // and runs it on each of its contexts.
+        std::lock_guard lock(m_broadcastMutex);
+        auto latch = std::make_shared<std::latch>(m_workers.size());
+        for (std::size_t i = 0; i < m_workers.size(); i++)
+        {
+            m_queue.push({ [&process](paint& context) {
+                try
+                {
+                    std::invoke(process, context);
+                }
+                catch (const std::exception& e)
+                {
+                    SPDLOG_ERROR("{}", e.what());
+                }
+            }, std::nullopt, latch });
+        }
+        latch->wait();
+    }
+
+    std::size_t paintPool::size() const
+    {
+        return m_workers.size();
+    }
+
+    std::size_t paintPool::pending() const
+    {
+        // Negative while workers are blocked waiting for work.
+        return (std::size_t)std::max<std::ptrdiff_t>(m_queue.size(), 0);
+    }
+
+    std::size_t paintPool::capacity() const
+    {
+        return (std::size_t)m_queue.capacity();
+    }
+
+    std::uint64_t paintPool::shed() const
+    {
+        return m_shed;
+    }
+
+    void paintPool::mainLoop()
+    {
+        SDL_Event e{};
+        while (SDL_WaitEvent(&e))
+        {
+            switch ((PaintEvent)e.type)
+            {
+                case PaintEvent::QUIT:
+                    return;
+                default:
+                    break;
+            }
+        }
+        SPDLOG_ERROR("{}", SDL_GetError());
+    }
+
+    bool paintPool::postQuit()
+    {
+        SDL_Event e{ SDL_EVENT_QUIT };
+        return SDL_PushEvent(&e);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <functional>
+#include <future>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <tbb/concurrent_queue.h>
+#include "yobot_paint.h"
+
+namespace yobot {
+
+    // Owns one paint context per worker thread and scale, all created before the pool
+    // is ready. Draw processes are taken from a shared bounded queue by whichever
+    // worker is free, so renders run in parallel.
+    class paintPool
+    {
+    public:
+        using DrawProcess = std::function<void(paint&)>;
+    public:
+        paintPool(std::size_t workerCount, std::size_t queueDepth, LayoutKind kind = LayoutKind::STANDARD, Theme theme = Theme::CLASSIC);
+        ~paintPool();
+        paintPool(paintPool&) = delete;
+        paintPool(paintPool&&) = delete;
+    public:
+        // Returns an invalid future without queueing when the queue is full. The process
+        // runs on the worker's context for scale and reads the canvas in place, so nothing is copied out.
+        std::future<void> postDrawProcess(DrawProcess process, Scale scale = Scale::ONE);
+        // Runs process on every context of every worker.
+        void broadcast(const DrawProcess& process);
+        std::size_t size() const;
+        std::size_t pending() const;
+        std::size_t capacity() const;
+        std::uint64_t shed() const;
+        void mainLoop();
+        bool postQuit();
+    private:
+        // A process for the context of scale, or for all of them without one. No process stops the worker.
+        struct Job
+        {
+            DrawProcess process;
+            std::optional<Scale> scale;
+            // Holds the worker after the process until every worker has run its copy.
+            std::shared_ptr<std::latch> latch;
+        };
+        void workerLoop(std::promise<void>& ready, LayoutKind kind, Theme theme);
+    private:
+        tbb::concurrent_bounded_queue<Job> m_queue;
+        std::mutex m_broadcastMutex;
+        std::atomic<std::uint64_t> m_shed;
+        std::vector<std::jthread> m_workers;
+    };
+}
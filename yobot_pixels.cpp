@@ -0,0 +1,306 @@
+#include "yobot_pixels.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define YOBOT_PIXELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define YOBOT_PIXELS_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(YOBOT_PIXELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define YOBOT_TARGET(isa) __attribute__((target(isa)))
+#else
+#define YOBOT_TARGET(isa)
+#endif
+
+namespace yobot::pixels {
+
+    using FillRow = void (*)(std::uint32_t* dst, std::size_t count, std::uint32_t pixel);
+    using CompositeRow = void (*)(const std::uint32_t* src, std::uint32_t* dst, std::size_t count);
+
+    struct Kernels
+    {
+        std::string_view name;
+        FillRow fill;
+        CompositeRow composite;
+    };
+
+    // SDL's ALPHA_BLEND_CHANNEL: (s * a + d * (255 - a)) / 255 with its exact rounding.
+    static inline std::uint32_t BlendChannel(std::uint32_t s, std::uint32_t d, std::uint32_t a)
+    {
+        auto x = s * a + d * (255 - a) + 1;
+        return (x + (x >> 8)) >> 8;
+    }
+
+    static inline std::uint32_t BlendPixel(std::uint32_t s, std::uint32_t d)
+    {
+        auto a = s >> 24;
+        return BlendChannel(255, d >> 24, a) << 24
+            | BlendChannel(s >> 16 & 0xff, d >> 16 & 0xff, a) << 16
+            | BlendChannel(s >> 8 & 0xff, d >> 8 & 0xff, a) << 8
+            | BlendChannel(s & 0xff, d & 0xff, a);
+    }
+
+    static void FillScalar(std::uint32_t* dst, std::size_t count, std::uint32_t pixel)
+    {
+        std::fill_n(dst, count, pixel);
+    }
+
+    static void CompositeScalar(const std::uint32_t* src, std::uint32_t* dst, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            dst[i] = BlendPixel(src[i], dst[i]);
+        }
+    }
+
+#ifdef YOBOT_PIXELS_X86
+    // Four pixels widened to 16-bit channels; the source alpha lane blends 255 so the
+    // result alpha is a + d * (255 - a) / 255, the same as the color lanes' formula.
+    YOBOT_TARGET("sse4.1")
+    static inline __m128i BlendHalfSSE(__m128i s, __m128i d)
+    {
+        const auto alphaOf = _mm_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+        const auto alphaLane = _mm_setr_epi16(0, 0, 0, 0xff, 0, 0, 0, 0xff);
+        auto a = _mm_shuffle_epi8(s, alphaOf);
+        auto x = _mm_add_epi16(_mm_mullo_epi16(_mm_or_si128(s, alphaLane), a), _mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a)));
+        x = _mm_add_epi16(x, _mm_set1_epi16(1));
+        return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    }
+
+    YOBOT_TARGET("sse4.1")
+    static void FillSSE(std::uint32_t* dst, std::size_t count, std::uint32_t pixel)
+    {
+        auto v = _mm_set1_epi32((int)pixel);
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm_storeu_si128((__m128i*)(dst + i), v);
+        }
+        FillScalar(dst + i, count - i, pixel);
+    }
+
+    YOBOT_TARGET("sse4.1")
+    static void CompositeSSE(const std::uint32_t* src, std::uint32_t* dst, std::size_t count)
+    {
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            auto s = _mm_loadu_si128((const __m128i*)(src + i));
+            auto d = _mm_loadu_si128((const __m128i*)(dst + i));
+            auto lo = BlendHalfSSE(_mm_cvtepu8_epi16(s), _mm_cvtepu8_epi16(d));
+            auto hi = BlendHalfSSE(_mm_cvtepu8_epi16(_mm_srli_si128(s, 8)), _mm_cvtepu8_epi16(_mm_srli_si128(d, 8)));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+        }
+        CompositeScalar(src + i, dst + i, count - i);
+    }
+
+    YOBOT_TARGET("avx2")
+    static inline __m256i BlendHalfAVX2(__m256i s, __m256i d)
+    {
+        const auto alphaOf = _mm256_setr_epi8(
+            6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15,
+            6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+        const auto alphaLane = _mm256_setr_epi16(0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff);
+        auto a = _mm256_shuffle_epi8(s, alphaOf);
+        auto x = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_or_si256(s, alphaLane), a), _mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), a)));
+        x = _mm256_add_epi16(x, _mm256_set1_epi16(1));
+        return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+    }
+
+    YOBOT_TARGET("avx2")
+    static void FillAVX2(std::uint32_t* dst, std::size_t count, std::uint32_t pixel)
+    {
+        auto v = _mm256_set1_epi32((int)pixel);
+        std::size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm256_storeu_si256((__m256i*)(dst + i), v);
+        }
+        FillScalar(dst + i, count - i, pixel);
+    }
+
+    YOBOT_TARGET("avx2")
+    static void CompositeAVX2(const std::uint32_t* src, std::uint32_t* dst, std::size_t count)
+    {
+        std::size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            auto s = _mm256_loadu_si256((const __m256i*)(src + i));
+            auto d = _mm256_loadu_si256((const __m256i*)(dst + i));
+            auto lo = BlendHalfAVX2(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(s)), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(d)));
+            auto hi = BlendHalfAVX2(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(s, 1)), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(d, 1)));
+            // packus interleaves the 128-bit lanes; put the four pixel pairs back in order.
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+        CompositeScalar(src + i, dst + i, count - i);
+    }
+
+    static bool CpuSupports(std::string_view isa)
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        auto sse41 = (info[2] & (1 << 19)) != 0;
+        __cpuidex(info, 7, 0);
+        auto avx2 = (info[1] & (1 << 5)) != 0;
+        return isa == "avx2" ? avx2 : sse41;
+#else
+        return isa == "avx2" ? __builtin_cpu_supports("avx2") : __builtin_cpu_supports("sse4.1");
+#endif
+    }
+#endif
+
+#ifdef YOBOT_PIXELS_NEON
+    static void FillNEON(std::uint32_t* dst, std::size_t count, std::uint32_t pixel)
+    {
+        auto v = vdupq_n_u32(pixel);
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            vst1q_u32(dst + i, v);
+        }
+        FillScalar(dst + i, count - i, pixel);
+    }
+
+    static inline uint8x8_t BlendHalfNEON(uint16x8_t s, uint16x8_t d, uint16x8_t a)
+    {
+        auto x = vmlaq_u16(vmulq_u16(s, a), d, vsubq_u16(vdupq_n_u16(255), a));
+        x = vaddq_u16(x, vdupq_n_u16(1));
+        return vshrn_n_u16(vsraq_n_u16(x, x, 8), 8);
+    }
+
+    static void CompositeNEON(const std::uint32_t* src, std::uint32_t* dst, std::size_t count)
+    {
+        const uint8x16_t alphaOf = { 3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15 };
+        const auto alphaLane = vreinterpretq_u8_u32(vdupq_n_u32(0xff000000));
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            auto s = vreinterpretq_u8_u32(vld1q_u32(src + i));
+            auto d = vreinterpretq_u8_u32(vld1q_u32(dst + i));
+            auto a = vqtbl1q_u8(s, alphaOf);
+            s = vorrq_u8(s, alphaLane);
+            auto lo = BlendHalfNEON(vmovl_u8(vget_low_u8(s)), vmovl_u8(vget_low_u8(d)), vmovl_u8(vget_low_u8(a)));
+            auto hi = BlendHalfNEON(vmovl_high_u8(s), vmovl_high_u8(d), vmovl_high_u8(a));
+            vst1q_u32(dst + i, vreinterpretq_u32_u8(vcombine_u8(lo, hi)));
+        }
+        CompositeScalar(src + i, dst + i, count - i);
+    }
+#endif
+
+    // Widest first; the first one the CPU supports is the default.
+    static const auto& Implementations()
+    {
+        static const auto implementations = std::to_array<Kernels>({
+#ifdef YOBOT_PIXELS_X86
+            { "avx2", FillAVX2, CompositeAVX2 },
+            { "sse4.1", FillSSE, CompositeSSE },
+#endif
+#ifdef YOBOT_PIXELS_NEON
+            { "neon", FillNEON, CompositeNEON },
+#endif
+            { "scalar", FillScalar, CompositeScalar },
+        });
+        return implementations;
+    }
+
+    static bool Supported(const Kernels& kernels)
+    {
+#ifdef YOBOT_PIXELS_X86
+        if (kernels.name == "avx2" || kernels.name == "sse4.1")
+        {
+            return CpuSupports(kernels.name);
+        }
+#endif
+        return true;
+    }
+
+    static std::atomic<const Kernels*>& Current()
+    {
+        static std::atomic<const Kernels*> current = [] {
+            auto&& implementations = Implementations();
+            return &*std::ranges::find_if(implementations, Supported);
+        }();
+        return current;
+    }
+
+    std::string_view isa()
+    {
+        return Current().load()->name;
+    }
+
+    bool select(std::string_view name)
+    {
+        auto&& implementations = Implementations();
+        auto it = std::ranges::find(implementations, name, &Kernels::name);
+        if (it == implementations.end() || !Supported(*it))
+        {
+            return false;
+        }
+        Current() = &*it;
+        return true;
+    }
+
+    static std::uint32_t* Row(SDL_Surface* surface, int y)
+    {
+        return reinterpret_cast<std::uint32_t*>(static_cast<std::uint8_t*>(surface->pixels) + (std::ptrdiff_t)y * surface->pitch);
+    }
+
+    static const std::uint32_t* Row(const SDL_Surface* surface, int y)
+    {
+        return reinterpret_cast<const std::uint32_t*>(static_cast<const std::uint8_t*>(surface->pixels) + (std::ptrdiff_t)y * surface->pitch);
+    }
+
+    void fill(SDL_Surface* dst, const SDL_Rect& rect, const SDL_Color& color)
+    {
+        auto bounds = SDL_Rect{ 0, 0, dst->w, dst->h };
+        SDL_Rect clipped;
+        if (dst->format != SDL_PIXELFORMAT_ARGB8888 || !SDL_GetRectIntersection(&rect, &bounds, &clipped))
+        {
+            return;
+        }
+        auto pixel = (std::uint32_t)color.a << 24 | (std::uint32_t)color.r << 16 | (std::uint32_t)color.g << 8 | color.b;
+        auto kernel = Current().load()->fill;
+        for (int y = clipped.y; y < clipped.y + clipped.h; y++)
+        {
+            kernel(Row(dst, y) + clipped.x, clipped.w, pixel);
+        }
+    }
+
+    void composite(const SDL_Surface* src, const SDL_Rect& srcRect, SDL_Surface* dst, const SDL_Point& pos)
+    {
+        if (src->format != SDL_PIXELFORMAT_ARGB8888 || dst->format != SDL_PIXELFORMAT_ARGB8888)
+        {
+            return;
+        }
+        // Clip against both surfaces, keeping source and destination aligned.
+        auto srcBounds = SDL_Rect{ 0, 0, src->w, src->h };
+        SDL_Rect from;
+        if (!SDL_GetRectIntersection(&srcRect, &srcBounds, &from))
+        {
+            return;
+        }
+        auto to = SDL_Rect{ pos.x + from.x - srcRect.x, pos.y + from.y - srcRect.y, from.w, from.h };
+        auto dstBounds = SDL_Rect{ 0, 0, dst->w, dst->h };
+        SDL_Rect clipped;
+        if (!SDL_GetRectIntersection(&to, &dstBounds, &clipped))
+        {
+            return;
+        }
+        auto offsetX = from.x + clipped.x - to.x;
+        auto offsetY = from.y + clipped.y - to.y;
+        auto kernel = Current().load()->composite;
+        for (int y = 0; y < clipped.h; y++)
+        {
+            kernel(Row(src, offsetY + y) + offsetX, Row(dst, clipped.y + y) + clipped.x, clipped.w);
+        }
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <string_view>
+#include <SDL3/SDL_surface.h>
+
+namespace yobot {
+
+    // Fill and compositing loops on ARGB8888 surfaces, bit-exact with what SDL's
+    // software renderer produces for the same integer rects. The widest implementation
+    // the CPU supports (avx2, sse4.1, neon, scalar) is picked on first use.
+    namespace pixels {
+        std::string_view isa();
+        // Switches to the named implementation; false when this CPU or build lacks it.
+        bool select(std::string_view name);
+
+        // Stores color into the rect, like a draw with SDL_BLENDMODE_NONE.
+        void fill(SDL_Surface* dst, const SDL_Rect& rect, const SDL_Color& color);
+        // Blends srcRect of src over dst at pos, like SDL_BlitSurface with SDL_BLENDMODE_BLEND.
+        void composite(const SDL_Surface* src, const SDL_Rect& srcRect, SDL_Surface* dst, const SDL_Point& pos);
+    }
+}
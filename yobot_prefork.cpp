@@ -0,0 +1,508 @@
+#include "yobot_prefork.h"
+#include "yobot_bossData.h"
+#include <httplib.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+namespace yobot {
+
+#ifndef _WIN32
+    // Anonymous and shared, so the mapping survives fork() in every child.
+    static void* MapShared(std::size_t size)
+    {
+        auto region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED)
+        {
+            SPDLOG_ERROR("mmap {} bytes failed: {}", size, std::strerror(errno));
+            return nullptr;
+        }
+        return region;
+    }
+
+    static void UnmapShared(void* region, std::size_t size)
+    {
+        if (region)
+        {
+            munmap(region, size);
+        }
+    }
+
+    static std::int64_t CurrentProcess()
+    {
+        return getpid();
+    }
+
+    static bool ProcessAlive(std::int64_t pid)
+    {
+        return pid > 0 && (kill((pid_t)pid, 0) == 0 || errno == EPERM);
+    }
+#else
+    static void* MapShared(std::size_t size)
+    {
+        return nullptr;
+    }
+
+    static void UnmapShared(void* region, std::size_t size)
+    {
+    }
+
+    static std::int64_t CurrentProcess()
+    {
+        return 0;
+    }
+
+    static bool ProcessAlive(std::int64_t pid)
+    {
+        return false;
+    }
+#endif
+
+    // Every field of the key, so a hash collision can never serve another image.
+    static std::string SerializeKey(const RenderKey& key)
+    {
+        std::string out;
+        auto append = [&out](const auto& value) {
+            out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+        append(key.generation);
+        append(key.lap);
+        append(key.lapFlags);
+        append(key.phase);
+        append(key.bossHPs);
+        append(key.scheduleStep);
+        append(key.format);
+        append(key.scale);
+        out.append(key.area).push_back('\0');
+        out.append(key.countDown.view());
+        return out;
+    }
+
+#ifndef _WIN32
+    using sharedMutex = pthread_mutex_t;
+#else
+    // Never mapped without fork(), so a process-local mutex keeps this compiling.
+    using sharedMutex = std::mutex;
+#endif
+
+    struct sharedCache::Header
+    {
+        sharedMutex mutex;
+        // Logical write position; ring offset is head % byteBudget.
+        std::uint64_t head;
+        std::atomic<std::uint64_t> hits;
+        std::atomic<std::uint64_t> misses;
+    };
+
+    struct sharedCache::Slot
+    {
+        std::uint64_t hash;
+        std::uint64_t position;
+        std::uint32_t keySize;
+        std::uint32_t size; // 0 for an empty slot
+    };
+
+    // Robust, so a worker dying with the lock held does not wedge the others.
+    class sharedLock
+    {
+    public:
+#ifndef _WIN32
+        explicit sharedLock(sharedMutex& mutex)
+            : m_mutex(mutex)
+        {
+            if (pthread_mutex_lock(&m_mutex) == EOWNERDEAD)
+            {
+                pthread_mutex_consistent(&m_mutex);
+            }
+        }
+
+        ~sharedLock()
+        {
+            pthread_mutex_unlock(&m_mutex);
+        }
+    private:
+        sharedMutex& m_mutex;
+#else
+        explicit sharedLock(sharedMutex& mutex)
+            : m_lock(mutex)
+        {
+        }
+    private:
+        std::lock_guard<sharedMutex> m_lock;
+#endif
+    };
+
+    sharedCache::sharedCache(std::size_t byteBudget, std::size_t slotCount)
+        : m_region(nullptr)
+        , m_regionSize(sizeof(Header) + sizeof(Slot) * slotCount + byteBudget)
+        , m_header(nullptr)
+        , m_slots(nullptr)
+        , m_ring(nullptr)
+        , m_slotCount(slotCount)
+        , m_byteBudget(byteBudget)
+    {
+        if (slotCount == 0 || byteBudget == 0)
+        {
+            return;
+        }
+        m_region = MapShared(m_regionSize);
+        if (!m_region)
+        {
+            return;
+        }
+        m_header = new (m_region) Header{};
+#ifndef _WIN32
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&m_header->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+#endif
+        // Fresh anonymous pages are zeroed, which already marks every slot empty.
+        m_slots = reinterpret_cast<Slot*>(m_header + 1);
+        m_ring = reinterpret_cast<char*>(m_slots + slotCount);
+    }
+
+    sharedCache::~sharedCache()
+    {
+        UnmapShared(m_region, m_regionSize);
+    }
+
+    bool sharedCache::valid() const
+    {
+        return m_header != nullptr;
+    }
+
+    renderCache::Buffer sharedCache::find(const RenderKey& key)
+    {
+        if (!m_header)
+        {
+            return nullptr;
+        }
+        auto serialized = SerializeKey(key);
+        auto hash = std::hash<std::string>{}(serialized);
+        {
+            sharedLock lock(m_header->mutex);
+            auto&& slot = m_slots[hash % m_slotCount];
+            // Live while nothing written since has wrapped around onto it.
+            auto live = slot.size != 0 && m_header->head - slot.position <= m_byteBudget;
+            if (live && slot.hash == hash && slot.keySize == serialized.size())
+            {
+                auto entry = m_ring + slot.position % m_byteBudget;
+                if (std::memcmp(entry, serialized.data(), serialized.size()) == 0)
+                {
+                    m_header->hits++;
+                    return std::make_shared<const std::string>(entry + slot.keySize, slot.size);
+                }
+            }
+        }
+        m_header->misses++;
+        return nullptr;
+    }
+
+    void sharedCache::insert(const RenderKey& key, const renderCache::Buffer& buffer)
+    {
+        if (!m_header || !buffer || buffer->empty())
+        {
+            return;
+        }
+        auto serialized = SerializeKey(key);
+        auto hash = std::hash<std::string>{}(serialized);
+        auto total = serialized.size() + buffer->size();
+        if (total > m_byteBudget)
+        {
+            return;
+        }
+        sharedLock lock(m_header->mutex);
+        auto position = m_header->head;
+        if (position % m_byteBudget + total > m_byteBudget)
+        {
+            position = (position / m_byteBudget + 1) * m_byteBudget;
+        }
+        // Move the head first: if this process dies mid-copy, the overwritten entries are already dead.
+        m_header->head = position + total;
+        auto entry = m_ring + position % m_byteBudget;
+        std::memcpy(entry, serialized.data(), serialized.size());
+        std::memcpy(entry + serialized.size(), buffer->data(), buffer->size());
+        m_slots[hash % m_slotCount] = { hash, position, (std::uint32_t)serialized.size(), (std::uint32_t)buffer->size() };
+    }
+
+    std::uint64_t sharedCache::hits() const
+    {
+        return m_header ? m_header->hits.load() : 0;
+    }
+
+    std::uint64_t sharedCache::misses() const
+    {
+        return m_header ? m_header->misses.load() : 0;
+    }
+
+    struct sharedGeneration::State
+    {
+        std::atomic<std::uint64_t> generation;
+        std::atomic<std::uint64_t> requested;
+        std::atomic<std::uint64_t> served;
+        std::atomic<std::uint32_t> areas; // bit i for area::all[i]
+    };
+
+    // One per worker index, rewritten by whichever process holds the index now.
+    struct sharedGeneration::Follower
+    {
+        std::atomic<std::int64_t> pid;
+        std::atomic<std::uint64_t> generation;
+    };
+
+    sharedGeneration::sharedGeneration(std::size_t workerCount)
+        : m_state(nullptr)
+        , m_followers(nullptr)
+        , m_workerCount(workerCount)
+    {
+        if (auto region = MapShared(sizeof(State) + sizeof(Follower) * m_workerCount))
+        {
+            m_state = new (region) State{};
+            m_state->generation = 1;
+            m_followers = reinterpret_cast<Follower*>(m_state + 1);
+            for (std::size_t i = 0; i < m_workerCount; i++)
+            {
+                new (m_followers + i) Follower{};
+            }
+        }
+    }
+
+    sharedGeneration::~sharedGeneration()
+    {
+        UnmapShared(m_state, sizeof(State) + sizeof(Follower) * m_workerCount);
+    }
+
+    std::uint64_t sharedGeneration::current() const
+    {
+        return m_state ? m_state->generation.load() : 1;
+    }
+
+    void sharedGeneration::publish(std::uint64_t generation)
+    {
+        if (m_state)
+        {
+            m_state->generation = generation;
+        }
+    }
+
+    std::uint64_t sharedGeneration::request(std::span<const std::string_view> areas)
+    {
+        if (!m_state)
+        {
+            return 0;
+        }
+        std::uint32_t mask = 0;
+        for (std::size_t i = 0; i < area::all.size(); i++)
+        {
+            if (std::ranges::find(areas, area::all[i]) != areas.end())
+            {
+                mask |= 1u << i;
+            }
+        }
+        m_state->areas |= mask;
+        return ++m_state->requested;
+    }
+
+    std::pair<std::uint64_t, std::vector<std::string_view>> sharedGeneration::take()
+    {
+        std::pair<std::uint64_t, std::vector<std::string_view>> ret;
+        if (!m_state)
+        {
+            return ret;
+        }
+        ret.first = m_state->requested;
+        auto mask = m_state->areas.exchange(0);
+        for (std::size_t i = 0; i < area::all.size(); i++)
+        {
+            if (mask & (1u << i))
+            {
+                ret.second.emplace_back(area::all[i]);
+            }
+        }
+        return ret;
+    }
+
+    void sharedGeneration::served(std::uint64_t ticket)
+    {
+        if (m_state && ticket > m_state->served)
+        {
+            m_state->served = ticket;
+        }
+    }
+
+    bool sharedGeneration::wait(std::uint64_t ticket, std::chrono::milliseconds timeout) const
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (m_state && m_state->served < ticket)
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        return true;
+    }
+
+    void sharedGeneration::followed(std::size_t index, std::uint64_t generation)
+    {
+        if (m_state && index < m_workerCount)
+        {
+            m_followers[index].generation = generation;
+            m_followers[index].pid = CurrentProcess();
+        }
+    }
+
+    bool sharedGeneration::waitFollowed(std::uint64_t generation, std::chrono::milliseconds timeout) const
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        auto behind = [&] {
+            // A dead worker's slot is skipped; its replacement reports once it has loaded the data.
+            return std::ranges::any_of(std::span(m_followers, m_workerCount), [generation](const Follower& x) {
+                return x.generation < generation && ProcessAlive(x.pid);
+            });
+        };
+        while (m_state && behind())
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        return true;
+    }
+
+#ifndef _WIN32
+    static volatile std::sig_atomic_t Stopping = 0;
+
+    static void OnStop(int)
+    {
+        Stopping = 1;
+    }
+
+    int prefork(std::size_t count, const std::function<int(std::size_t)>& worker)
+    {
+        struct sigaction action{};
+        action.sa_handler = OnStop;
+        // No SA_RESTART: waitpid() must return so the loop sees Stopping.
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        auto supervisor = getpid();
+        std::vector<pid_t> pids(count, 0);
+        auto spawn = [&](std::size_t index) {
+            auto pid = fork();
+            if (pid == 0)
+            {
+                std::signal(SIGINT, SIG_DFL);
+                std::signal(SIGTERM, SIG_DFL);
+#ifdef __linux__
+                prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+                if (getppid() != supervisor)
+                {
+                    std::_Exit(0);
+                }
+                std::exit(worker(index));
+            }
+            if (pid < 0)
+            {
+                SPDLOG_ERROR("fork failed: {}", std::strerror(errno));
+            }
+            pids[index] = std::max<pid_t>(pid, 0);
+            SPDLOG_INFO("worker {} pid:{}", index, pid);
+        };
+        for (std::size_t i = 0; i < count; i++)
+        {
+            spawn(i);
+        }
+        while (!Stopping)
+        {
+            int status = 0;
+            auto pid = waitpid(-1, &status, 0);
+            if (pid < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+            auto it = std::ranges::find(pids, pid);
+            if (it == pids.end())
+            {
+                continue;
+            }
+            auto index = (std::size_t)(it - pids.begin());
+            *it = 0;
+            SPDLOG_WARN("worker {} pid:{} exited status:{}", index, pid, status);
+            if (!Stopping)
+            {
+                // Keeps a worker that dies on startup from spinning the supervisor.
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                spawn(index);
+            }
+        }
+        for (auto&& pid : pids)
+        {
+            if (pid > 0)
+            {
+                kill(pid, SIGTERM);
+            }
+        }
+        while (waitpid(-1, nullptr, 0) > 0 || errno == EINTR)
+        {
+        }
+        SPDLOG_INFO("all workers stopped");
+        return 0;
+    }
+
+    void stopPrefork()
+    {
+        kill(getppid(), SIGTERM);
+    }
+
+    void reusePort(httplib::Server& server)
+    {
+        server.set_socket_options([](auto sock) {
+            int yes = 1;
+            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+            setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+        });
+    }
+#else
+    int prefork(std::size_t count, const std::function<int(std::size_t)>& worker)
+    {
+        SPDLOG_WARN("prefork is not supported on this platform, running a single process");
+        return worker(0);
+    }
+
+    void stopPrefork()
+    {
+    }
+
+    void reusePort(httplib::Server& server)
+    {
+    }
+#endif
+}
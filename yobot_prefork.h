@@ -0,0 +1,86 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "yobot_renderCache.h"
+
+namespace httplib {
+    class Server;
+}
+
+namespace yobot {
+
+    // Encoded images in an anonymous shared mapping. Created before forking, so every
+    // worker process serves what any of them rendered. Entries are appended to a ring
+    // and overwritten oldest first; the index is direct-mapped by key hash.
+    class sharedCache
+    {
+    public:
+        sharedCache(std::size_t byteBudget, std::size_t slotCount);
+        ~sharedCache();
+        sharedCache(sharedCache&) = delete;
+        sharedCache(sharedCache&&) = delete;
+    public:
+        // False when the mapping failed; the cache then stays empty.
+        bool valid() const;
+        renderCache::Buffer find(const RenderKey& key);
+        void insert(const RenderKey& key, const renderCache::Buffer& buffer);
+        std::uint64_t hits() const;
+        std::uint64_t misses() const;
+    private:
+        struct Header;
+        struct Slot;
+    private:
+        void* m_region;
+        std::size_t m_regionSize;
+        Header* m_header;
+        Slot* m_slots;
+        char* m_ring;
+        const std::size_t m_slotCount;
+        const std::size_t m_byteBudget;
+    };
+
+    // Boss data hand-off between worker processes: worker 0 fetches, saves and publishes
+    // the generation; the others reload the saved data whenever the generation moves.
+    // Each worker also reports the generation it serves, so /update can wait for all of them.
+    class sharedGeneration
+    {
+    public:
+        explicit sharedGeneration(std::size_t workerCount);
+        ~sharedGeneration();
+        sharedGeneration(sharedGeneration&) = delete;
+        sharedGeneration(sharedGeneration&&) = delete;
+    public:
+        std::uint64_t current() const;
+        void publish(std::uint64_t generation);
+        // Asks the fetching worker to refresh these areas; returns a ticket for wait().
+        std::uint64_t request(std::span<const std::string_view> areas);
+        // Latest ticket and the areas requested up to it, for the fetching worker.
+        std::pair<std::uint64_t, std::vector<std::string_view>> take();
+        void served(std::uint64_t ticket);
+        bool wait(std::uint64_t ticket, std::chrono::milliseconds timeout) const;
+        // Records that worker index now serves generation.
+        void followed(std::size_t index, std::uint64_t generation);
+        // Waits until every live worker serves generation or a later one.
+        bool waitFollowed(std::uint64_t generation, std::chrono::milliseconds timeout) const;
+    private:
+        struct State;
+        struct Follower;
+        State* m_state;
+        Follower* m_followers;
+        const std::size_t m_workerCount;
+    };
+
+    // Forks count processes running worker(index) and restarts any that die, until the
+    // supervisor gets SIGINT or SIGTERM. Without fork() the worker runs in-process.
+    int prefork(std::size_t count, const std::function<int(std::size_t)>& worker);
+    // Called from a worker to shut the whole group down.
+    void stopPrefork();
+    // Lets the server share its port with the other worker processes.
+    void reusePort(httplib::Server& server);
+}
@@ -0,0 +1,90 @@
+#include "yobot_progress.h"
+#include "yobot_metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace yobot {
+
+    void ensurePanel(paint& context, const BossSnapshot& snapshot, std::string_view area)
+    {
+        auto areaData = snapshot.find(area);
+        if (areaData && !context.hasPanel(area, snapshot.generation))
+        {
+            context.preparePanel(area, snapshot.generation, areaData->bossId);
+        }
+    }
+
+    RenderData prepareRenderData(const ClanStatus& status, const AreaSnapshot& areaData)
+    {
+        auto lap = status.lap;
+        auto phase = areaData.getPhase(lap);
+        auto [lapMin, lapMax] = areaData.lapRange[phase];
+        auto&& lapFlags = status.lapFlags;
+        auto&& bossFullHPs = areaData.bossHP[phase];
+        std::array<Progress, 5> bossProgreses;
+        for (size_t i = 0; i < bossProgreses.size(); i++)
+        {
+            bossProgreses[i] = { status.bossHPs[i],bossFullHPs[i] };
+        }
+        auto currentTime = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        auto [startTime, endTime] = areaData.timeRange;
+        std::array<Progress, 2> totalProgesses = { {
+            {(endTime > currentTime ? endTime - currentTime : 0),endTime - startTime},
+            {(lapMax == 999 ? 0 : lapMax - lap + 1),lapMax - lapMin + 1}
+        } };
+        char phaseChar = 'A' + phase;
+        return { lap, lapFlags, phaseChar, totalProgesses, bossProgreses };
+    }
+
+    RenderKey makeRenderKey(std::uint64_t generation, std::string_view area, const RenderData& renderData, ImageFormat format, LayoutKind kind, Scale scale)
+    {
+        auto&& [lap, lapFlags, phase, totalProgesses, bossProgreses] = renderData;
+        auto&& [remain, total] = totalProgesses[0];
+        auto scheduleStep = layout::filledPixels(layout::get(kind, scale).progress[0].w, total - remain, total);
+        RenderKey key{ generation, area, lap, lapFlags, phase, {}, getCountDownStr(remain), scheduleStep, format, scale };
+        for (size_t i = 0; i < bossProgreses.size(); i++)
+        {
+            key.bossHPs[i] = bossProgreses[i].first;
+        }
+        return key;
+    }
+
+    std::uint64_t renderTTL(const RenderData& renderData, LayoutKind kind, Scale scale)
+    {
+        auto&& [remain, total] = std::get<3>(renderData)[0];
+        auto ttl = getCountDownTTL(remain);
+        auto width = (std::uint64_t)layout::get(kind, scale).progress[0].w;
+        if (total != 0 && remain != 0 && width != 0)
+        {
+            // The first second at which filledPixels grows by one.
+            auto elapsed = total - remain;
+            auto nextPixel = ((elapsed * width / total + 1) * total + width - 1) / width;
+            ttl = std::min(ttl, nextPixel - elapsed);
+        }
+        return ttl;
+    }
+
+    void drawProgress(paint& context, const BossSnapshot& snapshot, const RenderKey& key, const RenderData& renderData, std::string& body)
+    {
+        auto&& [lap, lapFlags, phase, totalProgesses, bossProgreses] = renderData;
+        {
+            stageTimer timer(Stage::DRAW);
+            ensurePanel(context, snapshot, key.area);
+            context
+                .refreshBackground(key.area, phase)
+                .refreshTotalProgress(phase, totalProgesses)
+                .refreshBossProgress(lap, lapFlags, bossProgreses);
+        }
+        const SDL_Surface* canvas = nullptr;
+        {
+            stageTimer timer(Stage::FLUSH);
+            canvas = context.canvas();
+        }
+        stageTimer timer(Stage::ENCODE);
+        if (!encoder::getInstance().encode(key.format, canvas, body))
+        {
+            throw std::runtime_error("encode failed");
+        }
+    }
+}
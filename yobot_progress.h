@@ -0,0 +1,29 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include "yobot_bossData.h"
+#include "yobot_clanStore.h"
+#include "yobot_encoder.h"
+#include "yobot_paint.h"
+#include "yobot_renderCache.h"
+
+namespace yobot {
+
+    // lap, lap flags, phase, total progresses (time, laps) and boss progresses.
+    using RenderData = std::tuple<std::int64_t, std::array<bool, 5>, char, std::array<Progress, 2>, std::array<Progress, 5>>;
+
+    RenderData prepareRenderData(const ClanStatus& status, const AreaSnapshot& areaData);
+    // The schedule bar goes into the key as the pixels it fills on the kind and scale's layout.
+    RenderKey makeRenderKey(std::uint64_t generation, std::string_view area, const RenderData& renderData, ImageFormat format, LayoutKind kind, Scale scale);
+    // Seconds until the image of these inputs would change on its own: the countdown
+    // text or the schedule bar gaining a pixel, whichever comes first.
+    std::uint64_t renderTTL(const RenderData& renderData, LayoutKind kind, Scale scale);
+
+    // Rebuilds the context's panel of an area when it was built from older boss data.
+    void ensurePanel(paint& context, const BossSnapshot& snapshot, std::string_view area);
+    // Draws and encodes one image on the calling worker's context, which must be the one for key.scale.
+    void drawProgress(paint& context, const BossSnapshot& snapshot, const RenderKey& key, const RenderData& renderData, std::string& body);
+}
@@ -0,0 +1,157 @@
+#include "yobot_renderCache.h"
+#include <functional>
+
+namespace yobot {
+
+    static void HashCombine(std::size_t& seed, std::size_t value) noexcept
+    {
+        seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+    }
+
+    std::size_t RenderKeyHash::operator()(const RenderKey& key) const noexcept
+    {
+        std::size_t seed = std::hash<std::uint64_t>{}(key.generation);
+        HashCombine(seed, std::hash<std::string_view>{}(key.area));
+        HashCombine(seed, std::hash<std::int64_t>{}(key.lap));
+        for (auto&& flag : key.lapFlags)
+        {
+            HashCombine(seed, flag);
+        }
+        HashCombine(seed, std::hash<char>{}(key.phase));
+        for (auto&& hp : key.bossHPs)
+        {
+            HashCombine(seed, std::hash<std::uint64_t>{}(hp));
+        }
+        HashCombine(seed, std::hash<std::string_view>{}(key.countDown.view()));
+        HashCombine(seed, std::hash<std::uint64_t>{}(key.scheduleStep));
+        HashCombine(seed, (std::size_t)key.format);
+        HashCombine(seed, (std::size_t)key.scale);
+        return seed;
+    }
+
+    renderCache::renderCache(std::size_t byteBudget)
+        : m_bytes(0)
+        , m_byteBudget(byteBudget)
+        , m_hits(0)
+        , m_misses(0)
+    {
+    }
+
+    renderCache::Buffer renderCache::find(const RenderKey& key)
+    {
+        std::lock_guard lock(m_mutex);
+        auto it = m_index.find(key);
+        if (it == m_index.end())
+        {
+            m_misses++;
+            return nullptr;
+        }
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        m_hits++;
+        return it->second->second;
+    }
+
+    void renderCache::insert(const RenderKey& key, Buffer buffer)
+    {
+        if (!buffer || buffer->size() > m_byteBudget)
+        {
+            return;
+        }
+        std::lock_guard lock(m_mutex);
+        if (auto it = m_index.find(key); it != m_index.end())
+        {
+            m_bytes -= it->second->second->size();
+            m_entries.erase(it->second);
+            m_index.erase(it);
+        }
+        m_bytes += buffer->size();
+        m_entries.emplace_front(key, std::move(buffer));
+        m_index.emplace(key, m_entries.begin());
+        while (m_bytes > m_byteBudget)
+        {
+            auto& last = m_entries.back();
+            m_bytes -= last.second->size();
+            m_index.erase(last.first);
+            m_entries.pop_back();
+        }
+    }
+
+    void renderCache::clear()
+    {
+        std::lock_guard lock(m_mutex);
+        m_index.clear();
+        m_entries.clear();
+        m_bytes = 0;
+    }
+
+    std::uint64_t renderCache::hits() const
+    {
+        return m_hits;
+    }
+
+    std::uint64_t renderCache::misses() const
+    {
+        return m_misses;
+    }
+
+    std::size_t renderCache::bytes() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_bytes;
+    }
+
+    std::size_t renderCache::size() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_entries.size();
+    }
+
+    renderFlights::renderFlights()
+        : m_coalesced(0)
+    {
+    }
+
+    renderFlights::Buffer renderFlights::run(const RenderKey& key, const std::function<Buffer()>& render)
+    {
+        std::promise<Buffer> flight;
+        {
+            std::unique_lock lock(m_mutex);
+            auto [it, leader] = m_flights.try_emplace(key);
+            if (!leader)
+            {
+                auto follower = it->second;
+                lock.unlock();
+                m_coalesced++;
+                return follower.get();
+            }
+            it->second = flight.get_future().share();
+        }
+        Buffer buffer;
+        try
+        {
+            buffer = render();
+            flight.set_value(buffer);
+        }
+        catch (...)
+        {
+            flight.set_exception(std::current_exception());
+            std::lock_guard lock(m_mutex);
+            m_flights.erase(key);
+            throw;
+        }
+        std::lock_guard lock(m_mutex);
+        m_flights.erase(key);
+        return buffer;
+    }
+
+    std::uint64_t renderFlights::coalesced() const
+    {
+        return m_coalesced;
+    }
+
+    std::size_t renderFlights::inflight() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_flights.size();
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "tools.hpp"
+#include "yobot_encoder.h"
+#include "yobot_layout.h"
+
+namespace yobot {
+
+    // Everything that decides the pixels of a progress image.
+    struct RenderKey
+    {
+        std::uint64_t generation;
+        std::string_view area; // one of yobot::area::all
+        std::int64_t lap;
+        std::array<bool, 5> lapFlags;
+        char phase;
+        std::array<std::uint64_t, 5> bossHPs;
+        TextBuffer<24> countDown; // a yobot::CountDownText
+        std::uint64_t scheduleStep; // filled pixels of the schedule bar
+        ImageFormat format;
+        Scale scale;
+
+        bool operator==(const RenderKey&) const = default;
+    };
+
+    struct RenderKeyHash
+    {
+        std::size_t operator()(const RenderKey& key) const noexcept;
+    };
+
+    // Thread-safe LRU of encoded images, bounded by the total size of the stored buffers.
+    class renderCache
+    {
+    public:
+        using Buffer = std::shared_ptr<const std::string>;
+    public:
+        explicit renderCache(std::size_t byteBudget);
+        renderCache(renderCache&) = delete;
+        renderCache(renderCache&&) = delete;
+    public:
+        Buffer find(const RenderKey& key);
+        void insert(const RenderKey& key, Buffer buffer);
+        void clear();
+        std::uint64_t hits() const;
+        std::uint64_t misses() const;
+        std::size_t bytes() const;
+        std::size_t size() const;
+    private:
+        using Entry = std::pair<RenderKey, Buffer>;
+    private:
+        mutable std::mutex m_mutex;
+        std::list<Entry> m_entries;
+        std::unordered_map<RenderKey, std::list<Entry>::iterator, RenderKeyHash> m_index;
+        std::size_t m_bytes;
+        const std::size_t m_byteBudget;
+        std::atomic<std::uint64_t> m_hits;
+        std::atomic<std::uint64_t> m_misses;
+    };
+
+    // Single-flight gate: concurrent renders of the same key share the first caller's result.
+    class renderFlights
+    {
+    public:
+        using Buffer = renderCache::Buffer;
+    public:
+        renderFlights();
+        renderFlights(renderFlights&) = delete;
+        renderFlights(renderFlights&&) = delete;
+    public:
+        Buffer run(const RenderKey& key, const std::function<Buffer()>& render);
+        std::uint64_t coalesced() const;
+        std::size_t inflight() const;
+    private:
+        mutable std::mutex m_mutex;
+        std::unordered_map<RenderKey, std::shared_future<Buffer>, RenderKeyHash> m_flights;
+        std::atomic<std::uint64_t> m_coalesced;
+    };
+}